@@ -1,16 +1,34 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
-from esphome import pins
+from esphome import automation, pins
 from esphome.components import uart
+from esphome.components import binary_sensor
 from esphome.components import sensor
+from esphome.components import text_sensor
+from esphome.core import CORE
 from esphome.const import CONF_ID, CONF_HEIGHT, ICON_RULER, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT, UNIT_METER
+from esphome.const import DEVICE_CLASS_DURATION, DEVICE_CLASS_MOVING, UNIT_SECOND
+from esphome.const import CONF_TRIGGER_ID, CONF_UART_ID
 
 
 DEPENDENCIES = ['uart']
-AUTO_LOAD = ['sensor']
+AUTO_LOAD = ['binary_sensor', 'sensor', 'text_sensor']
 
 jarvis_cb2c_ns = cg.esphome_ns.namespace('fully_jarvis_cb2c')
 JarvisCB2CSensor = jarvis_cb2c_ns.class_('JarvisCB2CSensor', cg.Component, sensor.Sensor, uart.UARTDevice)
+JarvisCB2CHub = jarvis_cb2c_ns.class_('JarvisCB2CHub', cg.Component)
+
+# Automations
+HeightReachedTrigger = jarvis_cb2c_ns.class_('HeightReachedTrigger', automation.Trigger.template(cg.float_))
+MotionStartTrigger = jarvis_cb2c_ns.class_('MotionStartTrigger', automation.Trigger.template())
+MotionStopTrigger = jarvis_cb2c_ns.class_('MotionStopTrigger', automation.Trigger.template(cg.float_))
+ErrorTrigger = jarvis_cb2c_ns.class_('ErrorTrigger', automation.Trigger.template(cg.std_string))
+GotoHeightAction = jarvis_cb2c_ns.class_('GotoHeightAction', automation.Action)
+GotoPresetAction = jarvis_cb2c_ns.class_('GotoPresetAction', automation.Action)
+StopAction = jarvis_cb2c_ns.class_('StopAction', automation.Action)
+SequenceStartAction = jarvis_cb2c_ns.class_('SequenceStartAction', automation.Action)
+SequencePauseAction = jarvis_cb2c_ns.class_('SequencePauseAction', automation.Action)
+SequenceCancelAction = jarvis_cb2c_ns.class_('SequenceCancelAction', automation.Action)
 
 # The gpio pins remote manipulates to indicate a button press
 HC_0_PIN = "hc0_pin"
@@ -18,8 +36,74 @@ HC_1_PIN = "hc1_pin"
 HC_2_PIN = "hc2_pin"
 HC_3_PIN = "hc3_pin"
 
+# Send preset / settings commands over the UART instead of pulling the hc pins low
+SERIAL_COMMANDS = "serial_commands"
+# ESP32 only; read the UART from a dedicated task so height reports are timestamped as they arrive
+RX_TASK = "rx_task"
+# Number of 16 byte records to keep in the trace buffer; 0 turns tracing off
+TRACE_SIZE = "trace_size"
+# Only publish the height when it has moved more than this, no more often than the interval
+PUBLISH_HYSTERESIS = "publish_hysteresis"
+MIN_PUBLISH_INTERVAL = "min_publish_interval"
+# The height exactly as the controller sends it; tenths of an inch or mm
+RAW_HEIGHT = "raw_height"
+# Manual moves let go this long after the last do_manual_move() call
+JOG_TIMEOUT = "jog_timeout"
+
+# Everything else the controller reports about itself
+PRESET_HEIGHTS = ["preset_1_height", "preset_2_height", "preset_3_height", "preset_4_height"]
+MAX_HEIGHT = "max_height"
+MIN_HEIGHT = "min_height"
+UNITS = "units"
+ERROR = "error"
+MEMORY_MODE = "memory_mode"
+COLLISION_SENSITIVITY = "collision_sensitivity"
+
+# A goto_height() got there (within ~1mm; not if it gave up short); x is the height in m
+ON_HEIGHT_REACHED = "on_height_reached"
+# Any movement, whoever started it. on_motion_stop gets the height in m
+ON_MOTION_START = "on_motion_start"
+ON_MOTION_STOP = "on_motion_stop"
+# x is the code the handset shows; E01, ... or RESET
+ON_ERROR = "on_error"
+PRESET = "preset"
+
+# Worked out from the height reports
+VELOCITY = "velocity"
+MOVING = "moving"
+DIRECTION = "direction"
+LAST_MOVE_DURATION = "last_move_duration"
+LAST_MOVE_DISTANCE = "last_move_distance"
+# goto_height() only
+TIME_TO_TARGET = "time_to_target"
+TARGET_ERROR = "target_error"
+
+# Presets and limits are reported the same way as the height
+HEIGHT_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_METER,
+    icon=ICON_RULER,
+    accuracy_decimals=4,
+    device_class=DEVICE_CLASS_EMPTY,
+    state_class=STATE_CLASS_MEASUREMENT,
+)
+
+DURATION_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_SECOND,
+    icon="mdi:timer-outline",
+    accuracy_decimals=1,
+    device_class=DEVICE_CLASS_DURATION,
+    state_class=STATE_CLASS_MEASUREMENT,
+)
+
 
-CONFIG_SCHEMA = cv.COMPONENT_SCHEMA.extend(
+def validate_rx_task(value):
+    value = cv.boolean(value)
+    if value and not CORE.is_esp32:
+        raise cv.Invalid("rx_task is only available on ESP32")
+    return value
+
+
+DESK_SCHEMA = cv.COMPONENT_SCHEMA.extend(
     {
         # UID for the component
         cv.GenerateID(): cv.declare_id(JarvisCB2CSensor),
@@ -28,6 +112,14 @@ CONFIG_SCHEMA = cv.COMPONENT_SCHEMA.extend(
         cv.Optional(HC_1_PIN): pins.gpio_output_pin_schema,
         cv.Optional(HC_2_PIN): pins.gpio_output_pin_schema,
         cv.Optional(HC_3_PIN): pins.gpio_output_pin_schema,
+        cv.Optional(SERIAL_COMMANDS, default=False): cv.boolean,
+        cv.Optional(RX_TASK, default=False): validate_rx_task,
+        cv.Optional(TRACE_SIZE, default=0): cv.int_range(min=0, max=1024),
+        cv.Optional(PUBLISH_HYSTERESIS, default="0mm"): cv.All(cv.distance, cv.Range(min=0, max=0.1)),
+        cv.Optional(MIN_PUBLISH_INTERVAL, default="250ms"): cv.positive_time_period_milliseconds,
+        cv.Optional(JOG_TIMEOUT, default="200ms"): cv.All(
+            cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(milliseconds=50), max=cv.TimePeriod(seconds=2))
+        ),
 
         # Desk elevation
         cv.Optional(CONF_HEIGHT): sensor.sensor_schema(
@@ -41,11 +133,107 @@ CONFIG_SCHEMA = cv.COMPONENT_SCHEMA.extend(
             device_class=DEVICE_CLASS_EMPTY,
             state_class=STATE_CLASS_MEASUREMENT,
         ),
+
+        cv.Optional(RAW_HEIGHT): sensor.sensor_schema(
+            icon=ICON_RULER,
+            accuracy_decimals=0,
+            device_class=DEVICE_CLASS_EMPTY,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+
+        # Desk settings
+        cv.Optional(PRESET_HEIGHTS[0]): HEIGHT_SCHEMA,
+        cv.Optional(PRESET_HEIGHTS[1]): HEIGHT_SCHEMA,
+        cv.Optional(PRESET_HEIGHTS[2]): HEIGHT_SCHEMA,
+        cv.Optional(PRESET_HEIGHTS[3]): HEIGHT_SCHEMA,
+        cv.Optional(MAX_HEIGHT): HEIGHT_SCHEMA,
+        cv.Optional(MIN_HEIGHT): HEIGHT_SCHEMA,
+        cv.Optional(UNITS): text_sensor.text_sensor_schema(icon="mdi:ruler-square"),
+        cv.Optional(ERROR): text_sensor.text_sensor_schema(icon="mdi:alert-circle-outline"),
+        cv.Optional(MEMORY_MODE): text_sensor.text_sensor_schema(icon="mdi:gesture-tap-hold"),
+        cv.Optional(COLLISION_SENSITIVITY): text_sensor.text_sensor_schema(icon="mdi:car-brake-alert"),
+
+        # Motion
+        cv.Optional(VELOCITY): sensor.sensor_schema(
+            unit_of_measurement="m/s",
+            icon="mdi:speedometer",
+            accuracy_decimals=3,
+            device_class=DEVICE_CLASS_EMPTY,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+        cv.Optional(MOVING): binary_sensor.binary_sensor_schema(device_class=DEVICE_CLASS_MOVING),
+        cv.Optional(DIRECTION): text_sensor.text_sensor_schema(icon="mdi:swap-vertical"),
+        cv.Optional(LAST_MOVE_DURATION): DURATION_SCHEMA,
+        cv.Optional(LAST_MOVE_DISTANCE): HEIGHT_SCHEMA,
+        cv.Optional(TIME_TO_TARGET): DURATION_SCHEMA,
+        cv.Optional(TARGET_ERROR): HEIGHT_SCHEMA,
+
+        # Automations
+        cv.Optional(ON_HEIGHT_REACHED): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(HeightReachedTrigger)}
+        ),
+        cv.Optional(ON_MOTION_START): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(MotionStartTrigger)}
+        ),
+        cv.Optional(ON_MOTION_STOP): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(MotionStopTrigger)}
+        ),
+        cv.Optional(ON_ERROR): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(ErrorTrigger)}
+        ),
     }
 ).extend(uart.UART_DEVICE_SCHEMA)
 
+# Up to 3 desks on one node, one per UART. trace_size goes on the hub and is shared by every desk
+DESKS = "desks"
+HUB_MAX_DESKS = 3
+
+
+def validate_desks(desks):
+    uarts = [str(desk[CONF_UART_ID]) for desk in desks]
+    if len(set(uarts)) != len(uarts):
+        raise cv.Invalid("Each desk needs its own uart")
+    for desk in desks:
+        if desk[TRACE_SIZE]:
+            raise cv.Invalid("Set trace_size on the hub rather than on a desk")
+    return desks
+
+
+HUB_SCHEMA = cv.COMPONENT_SCHEMA.extend(
+    {
+        cv.GenerateID(): cv.declare_id(JarvisCB2CHub),
+        cv.Optional(TRACE_SIZE, default=0): cv.int_range(min=0, max=1024),
+        cv.Required(DESKS): cv.All(cv.ensure_list(DESK_SCHEMA), cv.Length(min=1, max=HUB_MAX_DESKS), validate_desks),
+    }
+)
+
+
+def validate_config(value):
+    # A list of desks makes this a hub; otherwise it's the one desk
+    if isinstance(value, dict) and DESKS in value:
+        return HUB_SCHEMA(value)
+    return DESK_SCHEMA(value)
+
+
+CONFIG_SCHEMA = validate_config
+
 
 async def to_code(config):
+    if DESKS not in config:
+        await desk_to_code(config)
+        return
+
+    hub = cg.new_Pvariable(config[CONF_ID])
+    await cg.register_component(hub, config)
+    if config[TRACE_SIZE]:
+        cg.add(hub.set_trace_size(config[TRACE_SIZE]))
+    for desk in config[DESKS]:
+        var = await desk_to_code(desk)
+        cg.add(var.set_log_tag(f"jarvis.2b2c.{desk[CONF_ID].id}"))
+        cg.add(hub.add_desk(var))
+
+
+async def desk_to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
     await uart.register_uart_device(var, config)
@@ -63,6 +251,122 @@ async def to_code(config):
         pin = await cg.gpio_pin_expression(config[HC_3_PIN])
         cg.add(var.set_hc3_pin(pin))
 
+    cg.add(var.set_serial_commands(config[SERIAL_COMMANDS]))
+    if config[RX_TASK]:
+        cg.add(var.set_rx_task(True))
+    if config[TRACE_SIZE]:
+        cg.add(var.set_trace_size(config[TRACE_SIZE]))
+    # Meters to tenths of a mm
+    cg.add(var.set_publish_hysteresis(round(config[PUBLISH_HYSTERESIS] * 10000)))
+    cg.add(var.set_min_publish_interval(config[MIN_PUBLISH_INTERVAL]))
+    cg.add(var.set_jog_timeout(config[JOG_TIMEOUT]))
+
     if CONF_HEIGHT in config:
         sens = await sensor.new_sensor(config[CONF_HEIGHT])
         cg.add(var.set_height_sensor(sens))
+    if RAW_HEIGHT in config:
+        sens = await sensor.new_sensor(config[RAW_HEIGHT])
+        cg.add(var.set_raw_height_sensor(sens))
+
+    for i, key in enumerate(PRESET_HEIGHTS):
+        if key in config:
+            sens = await sensor.new_sensor(config[key])
+            cg.add(var.set_preset_height_sensor(i + 1, sens))
+    if MAX_HEIGHT in config:
+        sens = await sensor.new_sensor(config[MAX_HEIGHT])
+        cg.add(var.set_max_height_sensor(sens))
+    if MIN_HEIGHT in config:
+        sens = await sensor.new_sensor(config[MIN_HEIGHT])
+        cg.add(var.set_min_height_sensor(sens))
+
+    if UNITS in config:
+        sens = await text_sensor.new_text_sensor(config[UNITS])
+        cg.add(var.set_units_text_sensor(sens))
+    if ERROR in config:
+        sens = await text_sensor.new_text_sensor(config[ERROR])
+        cg.add(var.set_error_text_sensor(sens))
+    if MEMORY_MODE in config:
+        sens = await text_sensor.new_text_sensor(config[MEMORY_MODE])
+        cg.add(var.set_memory_mode_text_sensor(sens))
+    if COLLISION_SENSITIVITY in config:
+        sens = await text_sensor.new_text_sensor(config[COLLISION_SENSITIVITY])
+        cg.add(var.set_collision_sensitivity_text_sensor(sens))
+
+    if VELOCITY in config:
+        sens = await sensor.new_sensor(config[VELOCITY])
+        cg.add(var.set_velocity_sensor(sens))
+    if MOVING in config:
+        sens = await binary_sensor.new_binary_sensor(config[MOVING])
+        cg.add(var.set_moving_binary_sensor(sens))
+    if DIRECTION in config:
+        sens = await text_sensor.new_text_sensor(config[DIRECTION])
+        cg.add(var.set_direction_text_sensor(sens))
+    if LAST_MOVE_DURATION in config:
+        sens = await sensor.new_sensor(config[LAST_MOVE_DURATION])
+        cg.add(var.set_last_move_duration_sensor(sens))
+    if LAST_MOVE_DISTANCE in config:
+        sens = await sensor.new_sensor(config[LAST_MOVE_DISTANCE])
+        cg.add(var.set_last_move_distance_sensor(sens))
+    if TIME_TO_TARGET in config:
+        sens = await sensor.new_sensor(config[TIME_TO_TARGET])
+        cg.add(var.set_time_to_target_sensor(sens))
+    if TARGET_ERROR in config:
+        sens = await sensor.new_sensor(config[TARGET_ERROR])
+        cg.add(var.set_target_error_sensor(sens))
+
+    for conf in config.get(ON_HEIGHT_REACHED, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(cg.float_, "x")], conf)
+    for conf in config.get(ON_MOTION_START, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [], conf)
+    for conf in config.get(ON_MOTION_STOP, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(cg.float_, "x")], conf)
+    for conf in config.get(ON_ERROR, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(cg.std_string, "x")], conf)
+
+    return var
+
+
+# Actions; the desk is picked with id: when there's more than one
+ACTION_SCHEMA = cv.Schema({cv.GenerateID(): cv.use_id(JarvisCB2CSensor)})
+# Actions that take nothing else can be written as just "fully_jarvis_cb2c.stop: desk"
+SIMPLE_ACTION_SCHEMA = automation.maybe_simple_id(ACTION_SCHEMA)
+
+
+@automation.register_action(
+    "fully_jarvis_cb2c.goto_height",
+    GotoHeightAction,
+    ACTION_SCHEMA.extend({cv.Required(CONF_HEIGHT): cv.templatable(cv.distance)}),
+)
+async def goto_height_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    height = await cg.templatable(config[CONF_HEIGHT], args, cg.float_)
+    cg.add(var.set_height(height))
+    return var
+
+
+@automation.register_action(
+    "fully_jarvis_cb2c.goto_preset",
+    GotoPresetAction,
+    ACTION_SCHEMA.extend({cv.Required(PRESET): cv.templatable(cv.int_range(min=1, max=4))}),
+)
+async def goto_preset_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    preset = await cg.templatable(config[PRESET], args, cg.uint8)
+    cg.add(var.set_preset(preset))
+    return var
+
+
+@automation.register_action("fully_jarvis_cb2c.stop", StopAction, SIMPLE_ACTION_SCHEMA)
+@automation.register_action("fully_jarvis_cb2c.sequence_start", SequenceStartAction, SIMPLE_ACTION_SCHEMA)
+@automation.register_action("fully_jarvis_cb2c.sequence_pause", SequencePauseAction, SIMPLE_ACTION_SCHEMA)
+@automation.register_action("fully_jarvis_cb2c.sequence_cancel", SequenceCancelAction, SIMPLE_ACTION_SCHEMA)
+async def simple_action_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    return var
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "esphome/core/automation.h"
+#include "fully_jarvis_cb2c.h"
+
+namespace esphome
+{
+  namespace fully_jarvis_cb2c
+  {
+    // x: where the desk ended up, meters
+    class HeightReachedTrigger : public Trigger<float>
+    {
+    public:
+      explicit HeightReachedTrigger(JarvisCB2CSensor *parent)
+      {
+        parent->add_on_height_reached_callback([this](float height) { this->trigger(height); });
+      }
+    };
+
+    class MotionStartTrigger : public Trigger<>
+    {
+    public:
+      explicit MotionStartTrigger(JarvisCB2CSensor *parent)
+      {
+        parent->add_on_motion_start_callback([this]() { this->trigger(); });
+      }
+    };
+
+    // x: where the desk stopped, meters
+    class MotionStopTrigger : public Trigger<float>
+    {
+    public:
+      explicit MotionStopTrigger(JarvisCB2CSensor *parent)
+      {
+        parent->add_on_motion_stop_callback([this](float height) { this->trigger(height); });
+      }
+    };
+
+    // x: what the handset shows; E01, E02, ... or RESET
+    class ErrorTrigger : public Trigger<std::string>
+    {
+    public:
+      explicit ErrorTrigger(JarvisCB2CSensor *parent)
+      {
+        parent->add_on_error_callback([this](std::string code) { this->trigger(code); });
+      }
+    };
+
+    // height: meters
+    template <typename... Ts>
+    class GotoHeightAction : public Action<Ts...>, public Parented<JarvisCB2CSensor>
+    {
+    public:
+      TEMPLATABLE_VALUE(float, height)
+
+      void play(Ts... x) override { this->parent_->goto_height(this->height_.value(x...) * 100.); }
+    };
+
+    template <typename... Ts>
+    class GotoPresetAction : public Action<Ts...>, public Parented<JarvisCB2CSensor>
+    {
+    public:
+      TEMPLATABLE_VALUE(uint8_t, preset)
+
+      void play(Ts... x) override { this->parent_->goto_preset(this->preset_.value(x...)); }
+    };
+
+    template <typename... Ts>
+    class StopAction : public Action<Ts...>, public Parented<JarvisCB2CSensor>
+    {
+    public:
+      void play(Ts... x) override { this->parent_->stop(); }
+    };
+
+    template <typename... Ts>
+    class SequenceStartAction : public Action<Ts...>, public Parented<JarvisCB2CSensor>
+    {
+    public:
+      void play(Ts... x) override { this->parent_->start_sequence(); }
+    };
+
+    template <typename... Ts>
+    class SequencePauseAction : public Action<Ts...>, public Parented<JarvisCB2CSensor>
+    {
+    public:
+      void play(Ts... x) override { this->parent_->pause_sequence(); }
+    };
+
+    template <typename... Ts>
+    class SequenceCancelAction : public Action<Ts...>, public Parented<JarvisCB2CSensor>
+    {
+    public:
+      void play(Ts... x) override { this->parent_->cancel_sequence(); }
+    };
+
+  } // namespace fully_jarvis_cb2c
+} // namespace esphome
@@ -0,0 +1,48 @@
+#include "cb2c_hub.h"
+#include "esphome/core/log.h"
+
+namespace esphome
+{
+      namespace fully_jarvis_cb2c
+      {
+            static const char *TAG = "jarvis.2b2c.hub";
+
+            void JarvisCB2CHub::add_desk(JarvisCB2CSensor *desk)
+            {
+                  if (this->desk_count_ == HUB_MAX_DESKS)
+                  {
+                        ESP_LOGE(TAG, "Only %u desks per hub", HUB_MAX_DESKS);
+                        return;
+                  }
+                  desk->attach_to_hub(this->desk_count_, &this->trace_);
+                  this->desks_[this->desk_count_++] = desk;
+            }
+
+            void JarvisCB2CHub::setup()
+            {
+                  if (this->trace_size_)
+                        this->trace_.init(this->trace_size_);
+            }
+
+            /*
+                  Deadlines for every desk first so a jog on the last desk never waits behind a burst of frames on the first,
+                        then each desk gets one poll(). Each poll() only works through what its UART already has buffered, so the
+                        cost is one desk's worth of work per desk.
+            */
+            void JarvisCB2CHub::loop()
+            {
+                  for (uint8_t i = 0; i < this->desk_count_; i++)
+                        this->desks_[i]->check_deadlines();
+                  for (uint8_t i = 0; i < this->desk_count_; i++)
+                        this->desks_[i]->poll();
+            }
+
+            void JarvisCB2CHub::dump_config()
+            {
+                  ESP_LOGCONFIG(TAG, "JarvisCB2C hub:");
+                  ESP_LOGCONFIG(TAG, "  Desks: %u", this->desk_count_);
+                  ESP_LOGCONFIG(TAG, "  Shared trace size: %u records", this->trace_size_);
+            }
+
+      } // namespace fully_jarvis_cb2c
+} // namespace esphome
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "esphome/core/component.h"
+#include "fully_jarvis_cb2c.h"
+#include "trace_buffer.h"
+
+namespace esphome
+{
+  namespace fully_jarvis_cb2c
+  {
+    // One per hardware UART on an ESP32
+    static const uint8_t HUB_MAX_DESKS = 3;
+
+    /*
+          Several desks on one node. The desks stay components (setup / dump_config / sensors as usual) but stop polling
+                from their own loop(); the hub polls them all from one loop() instead and gives them one trace buffer to
+                share, so a dump shows every desk's frames interleaved in the order they happened.
+    */
+    class JarvisCB2CHub : public Component
+    {
+    public:
+      // Before the desks, so the shared trace exists by the time they start writing to it
+      float get_setup_priority() const override { return setup_priority::LATE + 1.0f; }
+      void setup() override;
+      void loop() override;
+      void dump_config() override;
+
+      void add_desk(JarvisCB2CSensor *desk);
+      void set_trace_size(uint16_t size) { this->trace_size_ = size; }
+
+    protected:
+      JarvisCB2CSensor *desks_[HUB_MAX_DESKS]{};
+      uint8_t desk_count_{0};
+
+      uint16_t trace_size_{0};
+      TraceBuffer trace_;
+    };
+
+  } // namespace fully_jarvis_cb2c
+} // namespace esphome
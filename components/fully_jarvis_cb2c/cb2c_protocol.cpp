@@ -0,0 +1,140 @@
+#include "cb2c_protocol.h"
+
+namespace esphome
+{
+      namespace fully_jarvis_cb2c
+      {
+
+            bool verify_checksum(const uint8_t *frame, uint8_t len)
+            {
+                  // byte 0,1 are address
+                  // byte 2 is the command
+                  // byte 3 is the number of parameters
+                  if (len < JARVIS_FRAME_OVERHEAD || len > JARVIS_PACKET_MAX_LEN)
+                        return false;
+                  uint8_t param_len = frame[3];
+                  if (param_len != len - JARVIS_FRAME_OVERHEAD)
+                        return false;
+
+                  // Checksum is the 8 bit sum of all bytes after the first 2 up to the parameters.
+                  // It'll be the byte right after $param_len bytes beyond the 4th byte
+                  uint8_t calc_sum = 0;
+                  for (int i = 2; i < 4 + param_len; i++)
+                        calc_sum += frame[i];
+
+                  return calc_sum == frame[4 + param_len];
+            }
+
+            void FrameParser::push(uint8_t b)
+            {
+                  // read_frame() should be called after every byte so this should never happen, but if it does the oldest
+                  //    byte is the one least likely to be part of a useful frame
+                  if (this->count_ == JARVIS_RX_BUF_LEN)
+                        this->drop_(1);
+
+                  this->buf_[(this->head_ + this->count_) & (JARVIS_RX_BUF_LEN - 1)] = b;
+                  this->count_++;
+            }
+
+            void FrameParser::drop_(uint8_t n)
+            {
+                  this->head_ = (this->head_ + n) & (JARVIS_RX_BUF_LEN - 1);
+                  this->count_ -= n;
+                  this->dropped_bytes += n;
+            }
+
+            /*
+                  Offset of a whole, checksummed frame after the head, or 0 if there isn't one. Only looks for one ending in the byte
+                        just pushed; read_frame() runs after every push so anything shorter has already been looked at, and
+                        that keeps this to one compare for nearly every byte.
+            */
+            uint8_t FrameParser::find_complete_frame_() const
+            {
+                  if (this->at_(this->count_ - 1) != JARVIS_EOM)
+                        return 0;
+
+                  uint8_t frame[JARVIS_PACKET_MAX_LEN];
+                  for (uint8_t k = 1; k + JARVIS_FRAME_OVERHEAD <= this->count_; k++)
+                  {
+                        uint8_t addr = this->at_(k);
+                        uint8_t frame_len = this->count_ - k;
+                        if ((addr != JARVIS_ADDR_HANDSET && addr != JARVIS_ADDR_CONTROLLER) || this->at_(k + 1) != addr ||
+                            this->at_(k + 3) + JARVIS_FRAME_OVERHEAD != frame_len)
+                              continue;
+                        for (uint8_t i = 0; i < frame_len; i++)
+                              frame[i] = this->at_(k + i);
+                        if (verify_checksum(frame, frame_len))
+                              return k;
+                  }
+                  return 0;
+            }
+
+            /*
+                  Any time the bytes at the head can't be the start of a valid frame, we drop a single byte and try again.
+                        This means a corrupt frame costs us at most a re-scan of 9 bytes and we'll lock back on to the next
+                        0xF1F1 / 0xF2F2 address pair.
+            */
+            uint8_t FrameParser::read_frame(uint8_t *frame)
+            {
+                  while (this->count_ > 0)
+                  {
+                        uint8_t addr = this->at_(0);
+                        if (addr != JARVIS_ADDR_HANDSET && addr != JARVIS_ADDR_CONTROLLER)
+                        {
+                              this->drop_(1);
+                              continue;
+                        }
+
+                        // Need both address bytes
+                        if (this->count_ < 2)
+                              return 0;
+                        if (this->at_(1) != addr)
+                        {
+                              this->drop_(1);
+                              continue;
+                        }
+
+                        // Need the param count before we know how long the frame is
+                        if (this->count_ < 4)
+                              return 0;
+                        uint8_t param_len = this->at_(3);
+                        if (param_len > JARVIS_MAX_PARAMS)
+                        {
+                              this->drop_(1);
+                              continue;
+                        }
+
+                        uint8_t frame_len = param_len + JARVIS_FRAME_OVERHEAD;
+                        if (this->count_ < frame_len)
+                        {
+                              // Still waiting on the rest of it. If what's come in since is already a whole frame, what we're
+                              //    waiting on was noise that happened to start like one; don't sit on the good frame until
+                              //    enough bytes turn up to prove it
+                              uint8_t skip = this->find_complete_frame_();
+                              if (skip == 0)
+                                    return 0;
+                              this->drop_(skip);
+                              continue;
+                        }
+
+                        for (uint8_t i = 0; i < frame_len; i++)
+                              frame[i] = this->at_(i);
+
+                        if (frame[frame_len - 1] != JARVIS_EOM || !verify_checksum(frame, frame_len))
+                        {
+                              this->checksum_failures++;
+                              this->drop_(1);
+                              continue;
+                        }
+
+                        // Consumed, not dropped
+                        this->head_ = (this->head_ + frame_len) & (JARVIS_RX_BUF_LEN - 1);
+                        this->count_ -= frame_len;
+                        this->frames++;
+                        return frame_len;
+                  }
+                  return 0;
+            }
+
+      } // namespace fully_jarvis_cb2c
+} // namespace esphome
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+      The CB2C wire protocol. Nothing in here depends on ESPHome so the framing / checksum logic can be built and
+            poked at on any machine.
+      See: https://github.com/phord/Jarvis#uart-protocol and https://github.com/maraid/Jarvis#technical-notes
+*/
+namespace esphome
+{
+  namespace fully_jarvis_cb2c
+  {
+    // It appears that the LONGEST possible packet is 9 bytes
+    // See: https://github.com/phord/Jarvis#uart-protocol
+    static const uint8_t JARVIS_PACKET_MAX_LEN = 9;
+    // Bytes are buffered until a whole frame is available; must be a power of 2 and >= JARVIS_PACKET_MAX_LEN
+    static const uint8_t JARVIS_RX_BUF_LEN = 16;
+
+    // Every frame is: [addr][addr][command][param count][params...][checksum][EOM]
+    // The controller talks from 0xF2F2 and the handset from 0xF1F1
+    static const uint8_t JARVIS_ADDR_HANDSET = 0xF1;
+    static const uint8_t JARVIS_ADDR_CONTROLLER = 0xF2;
+    static const uint8_t JARVIS_EOM = 0x7E;
+    // Address (2) + command + param count + checksum + EOM
+    static const uint8_t JARVIS_FRAME_OVERHEAD = 6;
+    static const uint8_t JARVIS_MAX_PARAMS = JARVIS_PACKET_MAX_LEN - JARVIS_FRAME_OVERHEAD;
+
+    // Handset -> controller commands
+    static const uint8_t JARVIS_CMD_PROGMEM_1 = 0x03;
+    static const uint8_t JARVIS_CMD_PROGMEM_2 = 0x04;
+    static const uint8_t JARVIS_CMD_MOVE_1 = 0x05;
+    static const uint8_t JARVIS_CMD_MOVE_2 = 0x06;
+    static const uint8_t JARVIS_CMD_SETTINGS = 0x07;
+    static const uint8_t JARVIS_CMD_PHYS_LIMITS = 0x0C;
+    static const uint8_t JARVIS_CMD_SET_MAX = 0x21;
+    static const uint8_t JARVIS_CMD_SET_MIN = 0x22;
+    static const uint8_t JARVIS_CMD_CLEAR_LIMIT = 0x23;
+    static const uint8_t JARVIS_CMD_PROGMEM_3 = 0x25;
+    static const uint8_t JARVIS_CMD_PROGMEM_4 = 0x26;
+    static const uint8_t JARVIS_CMD_MOVE_3 = 0x27;
+    static const uint8_t JARVIS_CMD_MOVE_4 = 0x28;
+    static const uint8_t JARVIS_CMD_WAKE = 0x29;
+
+    // Controller -> handset commands
+    static const uint8_t JARVIS_CMD_HEIGHT = 0x01;
+    static const uint8_t JARVIS_CMD_ERROR = 0x02;
+    static const uint8_t JARVIS_CMD_RESET = 0x04;
+    static const uint8_t JARVIS_CMD_LIMITS = 0x20;
+    static const uint8_t JARVIS_CMD_MAX_HEIGHT = 0x21;
+    static const uint8_t JARVIS_CMD_MIN_HEIGHT = 0x22;
+    static const uint8_t JARVIS_CMD_LIMIT_STOP = 0x23;
+    static const uint8_t JARVIS_CMD_PRESET_1 = 0x25;
+    static const uint8_t JARVIS_CMD_PRESET_2 = 0x26;
+    static const uint8_t JARVIS_CMD_PRESET_3 = 0x27;
+    static const uint8_t JARVIS_CMD_PRESET_4 = 0x28;
+
+    // Used in both directions; the handset sets them and the controller reports them
+    static const uint8_t JARVIS_CMD_UNITS = 0x0E;
+    static const uint8_t JARVIS_CMD_MEM_MODE = 0x19;
+    static const uint8_t JARVIS_CMD_COLL_SENS = 0x1D;
+
+    // UNITS param
+    static const uint8_t JARVIS_UNITS_CM = 0x00;
+    static const uint8_t JARVIS_UNITS_INCH = 0x01;
+    // Until the controller tells us
+    static const uint8_t JARVIS_UNITS_UNKNOWN = 0xFF;
+
+    // LIMITS param is a bit field
+    static const uint8_t JARVIS_LIMIT_MAX = 0x01;
+    static const uint8_t JARVIS_LIMIT_MIN = 0x10;
+
+    /*
+          Describes how to handle one command: how many params it needs at minimum and what to call with the frame.
+          A table of these, plus a CommandIndex built from it at compile time, gets us from command byte to handler in a
+                single lookup.
+    */
+    template<typename H> struct CommandDescriptor
+    {
+      uint8_t cmd;
+      uint8_t param_len;
+      H handler;
+    };
+
+    // Command byte -> slot in a CommandDescriptor table
+    static const uint8_t JARVIS_NO_HANDLER = 0xFF;
+    struct CommandIndex
+    {
+      uint8_t slot[256];
+    };
+
+    template<typename H, size_t N> constexpr CommandIndex build_command_index(const CommandDescriptor<H> (&table)[N])
+    {
+      static_assert(N < JARVIS_NO_HANDLER, "Too many commands for a uint8_t index");
+      CommandIndex index{};
+      for (size_t i = 0; i < 256; i++)
+        index.slot[i] = JARVIS_NO_HANDLER;
+      for (size_t i = 0; i < N; i++)
+        index.slot[table[i].cmd] = i;
+      return index;
+    }
+
+    // Checksum is the 8 bit sum of the command, param count and params. $len is how many bytes $frame holds; a param count
+    //    that doesn't agree with it fails rather than being trusted
+    bool verify_checksum(const uint8_t *frame, uint8_t len);
+
+    // A complete frame, ready to be written to the UART
+    struct TxFrame
+    {
+      uint8_t data[JARVIS_PACKET_MAX_LEN];
+      uint8_t len;
+    };
+
+    /*
+          Build a frame from the handset to the controller:
+                0xF1, 0xF1, $cmd, $param_len, $params..., $checksum, 0x7E
+          Everything we send is known up front so these are built (checksum and all) at compile time. E.G. WAKE has no
+                params so the checksum of 0x29+0 is ... 0x29 :)
+    */
+    template<typename... P> constexpr TxFrame make_handset_frame(uint8_t cmd, P... params)
+    {
+      static_assert(sizeof...(P) <= JARVIS_MAX_PARAMS, "Too many params for one frame");
+      // Trailing 0 so this is never a zero length array
+      const uint8_t p[] = {static_cast<uint8_t>(params)..., 0};
+      const uint8_t param_len = sizeof...(P);
+
+      TxFrame f{};
+      f.data[0] = JARVIS_ADDR_HANDSET;
+      f.data[1] = JARVIS_ADDR_HANDSET;
+      f.data[2] = cmd;
+      f.data[3] = param_len;
+      uint8_t sum = cmd + param_len;
+      for (uint8_t i = 0; i < param_len; i++)
+      {
+        f.data[4 + i] = p[i];
+        sum += p[i];
+      }
+      f.data[4 + param_len] = sum;
+      f.data[5 + param_len] = JARVIS_EOM;
+      f.len = param_len + JARVIS_FRAME_OVERHEAD;
+      return f;
+    }
+
+    /*
+          Streaming frame parser. Bytes are pushed into a small ring buffer as they arrive and frames are pulled out
+                of it as soon as they are complete.
+          Whatever the input:
+                - nothing is read or written outside buf_ / $frame; every length comes from a byte that's been range checked
+                - as long as read_frame() is called after every push(), at most JARVIS_PACKET_MAX_LEN bytes are ever buffered, and
+                      a clean frame that follows a run of noise comes out as soon as its last byte is in, however the noise
+                      ended. The only exception is noise and frame together happening to checksum as a frame
+                - a frame only comes out with both address bytes, a sane param count, the EOM and a matching checksum
+          An 8 bit sum still lets the odd corrupt frame through, so the height handler checks reports for plausibility too.
+    */
+    class FrameParser
+    {
+    public:
+      void push(uint8_t b);
+
+      // Copies the next complete, checksum-verified frame into $frame (JARVIS_PACKET_MAX_LEN bytes) and returns its
+      //    length. Returns 0 once there's nothing more to be had from the bytes pushed so far.
+      uint8_t read_frame(uint8_t *frame);
+
+      // Running totals, for keeping an eye on line quality / parser cost
+      uint32_t frames{0};
+      uint32_t checksum_failures{0};
+      uint32_t dropped_bytes{0};
+
+    protected:
+      uint8_t buf_[JARVIS_RX_BUF_LEN];
+      uint8_t head_{0};
+      uint8_t count_{0};
+
+      uint8_t at_(uint8_t i) const { return this->buf_[(this->head_ + i) & (JARVIS_RX_BUF_LEN - 1)]; }
+      void drop_(uint8_t n);
+      uint8_t find_complete_frame_() const;
+    };
+
+  } // namespace fully_jarvis_cb2c
+} // namespace esphome
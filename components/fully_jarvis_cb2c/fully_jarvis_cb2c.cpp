@@ -1,7 +1,9 @@
-#include <math.h> /* round, floor, ceil, trunc */
+#include <math.h> /* round, floor, ceil, trunc, lround */
+#include <cstdlib>
 
 #include "fully_jarvis_cb2c.h"
 #include "esphome/core/log.h"
+#include "esphome/core/helpers.h"
 
 namespace esphome
 {
@@ -11,189 +13,923 @@ namespace esphome
             static const char *TAG = "jarvis.2b2c";
             // In testing w/ oscilloscope, the remote pulls the various control lines down for ~150ms
             static const int btn_delay_time = 150;
+            static const uint8_t PRESET_CHORDS[] = {BTN_PRESET_1, BTN_PRESET_2, BTN_PRESET_3, BTN_PRESET_4};
+            // The M button is a slightly shorter press
+            static const int m_btn_delay_time = 100;
+            // Gap between two queued presses so the controller sees them as separate presses
+            static const int btn_gap_time = 50;
 
-            // It appears that the LONGEST possible packet is 9 bytes
-            // See: https://github.com/phord/Jarvis#uart-protocol
-            static const uint8_t JARVIS_PACKET_MAX_LEN = 9;
+            // goto_height() tuning. Distances are in tenths of a mm
+            // Half of one tenth-of-an-inch step; anything tighter and an inch-mode desk could never get there
+            static const int32_t target_tolerance_tmm = 13;
+            // Closer than this and a full press would overshoot; go straight to nudging
+            static const int32_t nudge_zone_tmm = 100;
+            // A short tap that only just gets past the motor's soft start. Where nudges start; each direction learns its own
+            //    from there, lengthened until the desk is seen to move and scaled to the distance left
+            static const int nudge_time = 60;
+            // Past this the motor is at cruise and a nudge is just a short drive
+            static const int nudge_max_time = 400;
+            static const uint8_t max_nudges = 3;
+            // The controller stops sending new heights once the desk is still
+            static const uint32_t settle_time = 400;
+            // Each new velocity sample gets 1 / 2^velocity_shift of the weight
+            static const uint8_t velocity_shift = 1;
+            // Full travel takes ~20s; if a single press hasn't got there by this, something has gone wrong
+            static const uint32_t max_drive_time = 30000;
 
-            // TODO: is there a setup call I can override?
-            // At setup, I need to poke the desk to get it's current preset / units... etc
+            // Motion model defaults and learning rates
+            // Starting guess is ~38mm/s cruise coasting ~5mm after letting go
+            static const int32_t default_decel_tmm = 1500;
+            // Weight given to each new sample once the model has this many
+            static const uint16_t model_window = 10;
+            // Half of the remaining error gets folded into the overshoot correction after each move
+            static const int32_t max_overshoot_tmm = 150;
+
+            // Serial transmit pacing. A 9 byte frame takes ~10ms at 9600 baud; leave the controller a little room after each
+            static const uint32_t tx_gap_time = 25;
+            // How long to wait for the controller to acknowledge a frame before sending it again, and how many times to try
+            static const uint32_t tx_ack_timeout = 250;
+            static const uint8_t tx_max_tries = 3;
+
+            // Everything we ever send, checksums and all, built at compile time
+            static constexpr TxFrame FRAME_WAKE = make_handset_frame(JARVIS_CMD_WAKE);
+            static constexpr TxFrame FRAME_SETTINGS = make_handset_frame(JARVIS_CMD_SETTINGS);
+            static constexpr TxFrame FRAME_UNITS_CM = make_handset_frame(JARVIS_CMD_UNITS, JARVIS_UNITS_CM);
+            static constexpr TxFrame FRAME_UNITS_INCH = make_handset_frame(JARVIS_CMD_UNITS, JARVIS_UNITS_INCH);
+            static constexpr TxFrame FRAME_MOVE[] = {
+                make_handset_frame(JARVIS_CMD_MOVE_1),
+                make_handset_frame(JARVIS_CMD_MOVE_2),
+                make_handset_frame(JARVIS_CMD_MOVE_3),
+                make_handset_frame(JARVIS_CMD_MOVE_4),
+            };
+            static constexpr TxFrame FRAME_PROGMEM[] = {
+                make_handset_frame(JARVIS_CMD_PROGMEM_1),
+                make_handset_frame(JARVIS_CMD_PROGMEM_2),
+                make_handset_frame(JARVIS_CMD_PROGMEM_3),
+                make_handset_frame(JARVIS_CMD_PROGMEM_4),
+            };
+            static_assert(FRAME_WAKE.data[4] == 0x29 && FRAME_WAKE.len == 6, "WAKE frame should match what do_wake() always sent");
+
+            // Startup: how often / how many times we ask the controller for a height before giving up and waiting for it
+            static const uint32_t wake_retry_time = 250;
+            static const uint8_t max_wake_attempts = 4;
+
+            // Height reports further from the last one than the desk could have moved are held back until they repeat. The
+            //    desk tops out around 40mm/s; the slack covers inch rounding and a late report
+            static const int32_t max_speed_tmm_s = 1000;
+            static const int32_t height_jump_slack_tmm = 60;
+            // Anything outside this can't be a real desk height, whatever the units
+            static const int32_t min_plausible_tmm = 4000;
+            static const int32_t max_plausible_tmm = 16000;
+
+            // Sequences: how long to wait for a step to get the desk moving before deciding it was already there
+            static const uint32_t sequence_start_timeout = 3000;
+            // Preset recalls: long enough for every MOVE retry and the controller's soft start
+            static const uint32_t preset_start_timeout = 1500;
+
+            // At setup, we poke the desk to get it's current height / settings
             void JarvisCB2CSensor::setup()
             {
                   // this->dump_config();
-                  //  TODO: Might want to send WAKE 0x29 command to make sure the motor controller is alive
-                  //  TODO: might want to see if there is a inquiry message to get the current settings rather than just SET them
-                  //           e.g: 0x0E / UNITS is to SET the units... not to inquire what they are. It could be that this does not exist
-                  //           and the motor never asks the remote what units it should be using.
-                  //
                   //  I am reluctant to expose that functionality to HA because there could be some adverse effects. What happens if
                   //           ha -> esphome tells the motor to be in CM but the remote still thinks its in inches?
                   //////
+                  // The one and only allocation the trace makes. On a hub the hub's buffer is shared by all the desks
+                  if (this->trace_size_ && this->trace_ == &this->own_trace_)
+                        this->own_trace_.init(this->trace_size_);
+
                   // Default is to have all pins floating high; remote signals a button press by pulling low
-                  if (this->hc0_pin != nullptr)
-                        this->hc0_pin->digital_write(true);
+                  this->build_chord_masks_();
+                  this->write_chord_(BTN_ALL, false);
+
+                  ESP_LOGD(this->tag_, "Setup: Pins should be high!");
 
-                  if (this->hc1_pin != nullptr)
-                        this->hc1_pin->digital_write(true);
+                  // Restore whatever we learned about the desk before the last reboot
+                  this->model_pref_ = global_preferences->make_preference<MotionModel>(this->pref_hash_("jarvis_cb2c_motion_model_v3"), true);
+                  if (!this->model_pref_.load(&this->model_) || this->model_.decel_tmm_s2[MOTION_DOWN] <= 0 ||
+                      this->model_.decel_tmm_s2[MOTION_UP] <= 0 || this->model_.nudge_ms[MOTION_DOWN] < nudge_time ||
+                      this->model_.nudge_ms[MOTION_UP] < nudge_time)
+                  {
+                        ESP_LOGD(this->tag_, "Setup: No saved motion model, starting from defaults");
+                        for (uint8_t d = MOTION_DOWN; d <= MOTION_UP; d++)
+                        {
+                              this->model_.decel_tmm_s2[d] = default_decel_tmm;
+                              this->model_.overshoot_tmm[d] = 0;
+                              this->model_.samples[d] = 0;
+                              this->model_.nudge_ms[d] = nudge_time;
+                              this->model_.nudge_tmm[d] = 0;
+                        }
+                  }
 
-                  if (this->hc2_pin != nullptr)
-                        this->hc2_pin->digital_write(true);
+                  // Start from where the desk was when we last saw it stop. It almost certainly hasn't moved since.
+                  //    Saved already converted so it doesn't matter that we don't know the units yet
+                  this->height_pref_ = global_preferences->make_preference<int32_t>(this->pref_hash_("jarvis_cb2c_height_tmm"), true);
+                  int32_t saved_tmm;
+                  if (this->height_pref_.load(&saved_tmm) && saved_tmm > 0)
+                  {
+                        this->current_tmm_ = saved_tmm;
+                        ESP_LOGD(this->tag_, "Setup: Restored height: %d tmm", saved_tmm);
+                        if (this->height_sensor_ != nullptr)
+                              this->height_sensor_->publish_state(saved_tmm * .0001f);
+                        this->published_tmm_ = saved_tmm;
+                  }
+
+                  // A sequence that was running when we went down carries on once the desk reports in
+                  this->sequence_pref_ = global_preferences->make_preference<SequenceProgram>(this->pref_hash_("jarvis_cb2c_sequence"), true);
+                  if (!this->sequence_pref_.load(&this->sequence_) || this->sequence_.count > SEQUENCE_MAX_STEPS ||
+                      this->sequence_.step >= SEQUENCE_MAX_STEPS)
+                  {
+                        this->sequence_ = SequenceProgram{};
+                        this->sequence_.repeat = 1;
+                  }
+                  else if (this->sequence_.state != SEQUENCE_IDLE)
+                        ESP_LOGD(this->tag_, "Setup: Restored sequence at step %u of %u", this->sequence_.step + 1, this->sequence_.count);
 
-                  if (this->hc3_pin != nullptr)
-                        this->hc3_pin->digital_write(true);
+#ifdef USE_ESP32
+                  if (this->use_rx_task_)
+                  {
+                        // Keep the reader off the core that runs loop()
+                        BaseType_t core = portNUM_PROCESSORS > 1 ? 1 - xPortGetCoreID() : 0;
+                        if (xTaskCreatePinnedToCore(rx_task_, "jarvis_rx", 3072, this, 5, &this->rx_task_handle_, core) != pdPASS)
+                        {
+                              ESP_LOGE(this->tag_, "Setup: Couldn't start RX task, reading from loop() instead");
+                              this->use_rx_task_ = false;
+                        }
+                  }
+#endif
 
-                  ESP_LOGD(TAG, "Setup: Pins should be high!");
+                  // ... but ask the controller anyways. WAKE gets it to send a height report and SETTINGS gets units / presets
+                  this->request_height_();
             }
 
+#ifdef USE_ESP32
             /*
-                  Called every ~16ms. We read bytes until we have a valid packet
+                  RX task. Reads bytes as soon as the UART driver has them, so each frame is stamped within a tick of arriving
+                        rather than whenever loop() next gets around to it (up to ~16ms later).
+                  ESPHome's UART component doesn't expose the driver's event queue, so we poll it every tick instead. Reads are
+                        serialized by the UART component itself; loop() only ever writes once this task is running.
             */
-            void JarvisCB2CSensor::loop()
+            void JarvisCB2CSensor::rx_task_(void *arg)
             {
-                  uint8_t response[JARVIS_PACKET_MAX_LEN];
-                  uint8_t peeked;
+                  JarvisCB2CSensor *self = static_cast<JarvisCB2CSensor *>(arg);
+                  RxFrame rx;
+                  uint8_t b;
 
-                  // 0x7E is the End of Message byte
-                  while (this->available())
+                  while (true)
                   {
-                        // Get the byte
-                        this->peek_byte(&peeked);
-                        // ESP_LOGD(TAG, "peeked: %x \t %u", peeked, peeked);
+                        while (self->available())
+                        {
+                              self->read_byte(&b);
+                              self->parser_.push(b);
+                              while (self->parser_.read_frame(rx.data))
+                              {
+                                    rx.at_ms = millis();
+                                    if (!self->rx_queue_.push(rx))
+                                          self->rx_overflows_++;
+                              }
+                        }
+                        vTaskDelay(1);
+                  }
+            }
+#endif
+
+            /*
+                  Called every ~16ms. We drain whatever the UART has buffered and parse it a byte at a time.
+                  Nothing in here waits on the UART; if a frame is only partially received, the rest of it
+                        will be picked up on the next call.
+            */
+            void JarvisCB2CSensor::loop()
+            {
+                  // On a hub, the hub polls every desk from its own loop()
+                  if (!this->on_hub_)
+                        this->poll();
+            }
 
-                        if (peeked != 0x7e)
+            // On a hub every desk needs its own slots; a lone desk keeps the keys it has always had
+            uint32_t JarvisCB2CSensor::pref_hash_(const char *key) const
+            {
+                  if (!this->on_hub_)
+                        return fnv1_hash(key);
+                  return fnv1_hash(std::string(key) + "." + this->tag_);
+            }
+
+            void JarvisCB2CSensor::attach_to_hub(uint8_t index, TraceBuffer *trace)
+            {
+                  this->on_hub_ = true;
+                  this->trace_ = trace;
+                  this->trace_source_ = index << TRACE_SOURCE_SHIFT;
+            }
+
+            void JarvisCB2CSensor::poll()
+            {
+                  uint32_t started_us = micros();
+
+                  // First thing, so a late keepalive is caught no later than it has to be
+                  this->service_jog_(millis());
+
+                  // Release (or start) any timed button presses that are due
+                  this->service_buttons_();
+                  // ... and send the next queued frame if the line is free
+                  this->service_tx_();
+
+#ifdef USE_ESP32
+                  if (this->use_rx_task_)
+                  {
+                        RxFrame rx;
+                        while (this->rx_queue_.pop(rx))
                         {
-                              this->read();
-                              // There's nothing else for us to do so bail early
-                              return;
+                              this->rx_time_ms_ = rx.at_ms;
+                              this->handle_frame_(rx.data);
                         }
-                        else
+                  }
+                  else
+#endif
+                  {
+                        uint8_t b;
+                        uint8_t frame[JARVIS_PACKET_MAX_LEN];
+                        while (this->available())
                         {
-                              // We still read the byte for completeness then break out of the while loop to read/process the packet we have.
-                              this->read();
-                              ESP_LOGD(TAG, "EOM");
-                              break;
+                              this->read_byte(&b);
+                              this->parser_.push(b);
+                              while (this->parser_.read_frame(frame))
+                              {
+                                    this->rx_time_ms_ = millis();
+                                    this->handle_frame_(frame);
+                              }
                         }
                   }
 
-                  bool read_success = read_array(response, JARVIS_PACKET_MAX_LEN);
-                  if (!read_success)
+                  if (this->parser_.checksum_failures != this->reported_checksum_failures_)
                   {
-                        // Don't need this as there will be plenty of:
-                        //          Reading from UART timed out at byte 0!
-                        // in the logs
-                        ////
-                        // ESP_LOGE(TAG, "Failure reading UART bytes!");
+                        ESP_LOGW(this->tag_, "Checksum didn't match! (%u so far)", this->parser_.checksum_failures);
+                        this->trace_->record(micros(), TRACE_CHECKSUM_FAIL | this->trace_source_, reinterpret_cast<const uint8_t *>(&this->parser_.checksum_failures), 4);
+                        this->reported_checksum_failures_ = this->parser_.checksum_failures;
                         status_set_warning();
+                  }
 
-                        // Even though we didn't get anything from the UART, we still should move, if needed
-                        this->_adjust_height();
+                  uint32_t now = millis();
+                  if (!this->height_reported_ && this->wake_attempts_ < max_wake_attempts && now - this->last_wake_ms_ >= wake_retry_time)
+                        this->request_height_();
+
+                  // Once the desk has been still for a bit, remember where it stopped
+                  //    and make sure that's what was published last, whatever the hysteresis / interval held back
+                  if (this->height_dirty_ && now - this->last_change_ms_ >= settle_time)
+                  {
+                        this->height_pref_.save(&this->current_tmm_);
+                        this->height_dirty_ = false;
+                        this->publish_height_(true);
+                        if (this->in_motion_)
+                              this->motion_ended_();
+                  }
+
+                  // A preset recall that never got the desk moving
+                  if (this->preset_pending_ != 0 && !this->in_motion_ && now - this->preset_pending_since_ms_ >= preset_start_timeout)
+                  {
+                        ESP_LOGD(this->tag_, "Preset %u recall didn't start", this->preset_pending_);
+                        this->preset_pending_ = 0;
+                  }
+
+                  // If goto_height() has been called since we last ran
+                  this->_adjust_height();
+                  this->service_sequence_(now);
+
+                  // Only spin loop() flat out while there's something to react to
+                  if (this->move_state_ != MOVE_IDLE || this->btn_count_ != 0 || this->jog_dir_ != 0)
+                        this->high_freq_.start();
+                  else
+                        this->high_freq_.stop();
+
+                  uint32_t took_us = micros() - started_us;
+                  this->loop_count_++;
+                  this->loop_total_us_ += took_us;
+                  if (took_us > this->loop_max_us_)
+                        this->loop_max_us_ = took_us;
+            }
+
+            void JarvisCB2CSensor::request_height_()
+            {
+                  ESP_LOGD(this->tag_, "Asking controller for height (attempt %u)", this->wake_attempts_ + 1);
+                  this->queue_frame_(FRAME_WAKE, TX_NO_ACK);
+                  this->queue_frame_(FRAME_SETTINGS, TX_NO_ACK);
+                  this->wake_attempts_++;
+                  this->last_wake_ms_ = millis();
+            }
+
+            /*
+                  An 8 bit checksum lets roughly 1 in 256 corrupt frames through. For most reports that's harmless, but a bad height
+                        would be published, saved and acted on by goto_height(). So a report has to be a possible height, and one the
+                        desk could have reached since the last report. A report that fails the second test is only believed once
+                        it shows up twice in a row (the units changed, or we missed a stretch of reports).
+            */
+            bool JarvisCB2CSensor::height_plausible_(int32_t tmm)
+            {
+                  if (tmm < min_plausible_tmm || tmm > max_plausible_tmm)
+                  {
+                        this->implausible_heights_++;
+                        ESP_LOGD(this->tag_, "Ignoring impossible height %d tmm", tmm);
+                        return false;
+                  }
+
+                  uint32_t dt = this->rx_time_ms_ - this->last_report_ms_;
+                  if (!this->height_reported_ || dt >= 1000)
+                        return true;
+
+                  int32_t max_step = max_speed_tmm_s * (int32_t)dt / 1000 + height_jump_slack_tmm;
+                  if (std::abs(tmm - this->current_tmm_) <= max_step || std::abs(tmm - this->suspect_tmm_) <= height_jump_slack_tmm)
+                  {
+                        this->suspect_tmm_ = -1;
+                        return true;
+                  }
+
+                  this->implausible_heights_++;
+                  ESP_LOGD(this->tag_, "Holding back height %d tmm; was %d tmm %u ms ago", tmm, this->current_tmm_, dt);
+                  this->suspect_tmm_ = tmm;
+                  return false;
+            }
+
+            void JarvisCB2CSensor::handle_frame_(const uint8_t *frame)
+            {
+                  /*
+                        Everything we know how to decode, along with the minimum number of params we need to do so.
+                        The index tables are built at compile time so dispatch is a single lookup on the command byte.
+                  */
+                  static constexpr CommandDescriptor<FrameHandler> controller_commands[] = {
+                      {JARVIS_CMD_HEIGHT, 2, &JarvisCB2CSensor::on_height_},
+                      {JARVIS_CMD_ERROR, 1, &JarvisCB2CSensor::on_error_},
+                      {JARVIS_CMD_RESET, 0, &JarvisCB2CSensor::on_reset_},
+                      {JARVIS_CMD_UNITS, 1, &JarvisCB2CSensor::on_units_},
+                      {JARVIS_CMD_MEM_MODE, 1, &JarvisCB2CSensor::on_memory_mode_},
+                      {JARVIS_CMD_COLL_SENS, 1, &JarvisCB2CSensor::on_collision_sensitivity_},
+                      {JARVIS_CMD_LIMITS, 1, &JarvisCB2CSensor::on_limits_},
+                      {JARVIS_CMD_MAX_HEIGHT, 2, &JarvisCB2CSensor::on_limit_height_},
+                      {JARVIS_CMD_MIN_HEIGHT, 2, &JarvisCB2CSensor::on_limit_height_},
+                      {JARVIS_CMD_LIMIT_STOP, 1, &JarvisCB2CSensor::on_limit_stop_},
+                      {JARVIS_CMD_PRESET_1, 2, &JarvisCB2CSensor::on_preset_},
+                      {JARVIS_CMD_PRESET_2, 2, &JarvisCB2CSensor::on_preset_},
+                      {JARVIS_CMD_PRESET_3, 2, &JarvisCB2CSensor::on_preset_},
+                      {JARVIS_CMD_PRESET_4, 2, &JarvisCB2CSensor::on_preset_},
+                  };
+                  static constexpr CommandIndex controller_index = build_command_index(controller_commands);
+
+                  // We only ever see the handset if it's plugged in alongside us; nothing to do but note what it asked for
+                  static constexpr CommandDescriptor<FrameHandler> handset_commands[] = {
+                      {JARVIS_CMD_PROGMEM_1, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_PROGMEM_2, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_PROGMEM_3, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_PROGMEM_4, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_MOVE_1, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_MOVE_2, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_MOVE_3, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_MOVE_4, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_SETTINGS, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_PHYS_LIMITS, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_UNITS, 1, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_MEM_MODE, 1, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_COLL_SENS, 1, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_SET_MAX, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_SET_MIN, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_CLEAR_LIMIT, 0, &JarvisCB2CSensor::on_handset_command_},
+                      {JARVIS_CMD_WAKE, 0, &JarvisCB2CSensor::on_handset_command_},
+                  };
+                  static constexpr CommandIndex handset_index = build_command_index(handset_commands);
+
+                  // Checksum is good! Extract the 'command' byte and dispatch
+                  status_clear_warning();
+                  this->trace_->record(micros(), TRACE_RX_FRAME | this->trace_source_, frame, frame[3] + JARVIS_FRAME_OVERHEAD);
+                  uint8_t pkt_type = frame[2];
+
+                  if (frame[0] == JARVIS_ADDR_CONTROLLER)
+                        this->tx_ack_(pkt_type);
+
+                  const CommandDescriptor<FrameHandler> *desc;
+                  if (frame[0] == JARVIS_ADDR_CONTROLLER)
+                  {
+                        uint8_t slot = controller_index.slot[pkt_type];
+                        desc = slot == JARVIS_NO_HANDLER ? nullptr : &controller_commands[slot];
+                  }
+                  else
+                  {
+                        uint8_t slot = handset_index.slot[pkt_type];
+                        desc = slot == JARVIS_NO_HANDLER ? nullptr : &handset_commands[slot];
+                  }
+
+                  if (desc == nullptr)
+                  {
+                        ESP_LOGV(this->tag_, "Unhandled command 0x%02X from 0x%02X", pkt_type, frame[0]);
                         return;
                   }
-                  // Now we validate the packet
-                  if (!this->verify_cb2c_checksum_(response))
+                  if (frame[3] < desc->param_len)
                   {
-                        ESP_LOGW(TAG, "Checksum didn't match!");
-                        status_set_warning();
+                        ESP_LOGV(this->tag_, "Command 0x%02X needs %u params, got %u", pkt_type, desc->param_len, frame[3]);
                         return;
                   }
+                  (this->*(desc->handler))(frame);
+            }
 
-                  // Checksum is good! Extract the 'command' byte and dispatch
-                  uint8_t pkt_type = response[2];
-                  switch (pkt_type)
+            void JarvisCB2CSensor::on_height_(const uint8_t *frame)
+            {
+                  /*
+                        command 1: height report packet looks like this:
+
+                              [0] 0xf2         (242)
+                              [1] 0xf2         (242)
+                              [2] 0x1          (1)
+                              [3] 0x3          (3)
+                              [4] 0x1          (1)
+                              [5] 0x97         (151)
+                              [6] 0x3          (3)
+                              [7] 0x9f         (159)
+                              [8] 0x7e         (126)
+
+                        There should be 3 params, the first two are the high/low bytes and the third has unknown purpose
+                        See: https://github.com/phord/Jarvis#height-report
+                  */
+                  uint8_t height_hi = frame[4];  // 0x01
+                  uint8_t height_low = frame[5]; // 0x97
+
+                  // 0197 is 407 ... and the display says 40.7 on it!
+                  this->current_pos_ = (height_hi << 8) + height_low;
+                  ESP_LOGV(this->tag_, "height: %u", this->current_pos_);
+
+                  // Raw input will be in tenths of $UNIT. EG 407 -> 40.7 inches
+                  // to_tmm_(407) => 10338 (1033.8mm)
+                  // 10338 * .0001 = 1.0338
+                  // We will let ESPHome do the truncation for us; we define 4 decimals of accuracy so
+                  //   the reading will show as 1.0338m in HA. This is human friendly but still has enough
+                  //   precision in it so user can do meter to mm conversion (for whatever reason...) and they'll
+                  //   get something pretty accurate.
+                  int32_t tmm = this->to_tmm_(this->current_pos_);
+                  if (!this->height_plausible_(tmm))
+                        return;
+                  this->height_reported_ = true;
+                  if (tmm != this->current_tmm_)
+                        this->height_dirty_ = true;
+                  this->update_motion_(tmm, this->rx_time_ms_);
+                  this->publish_height_(false);
+            }
+
+            /*
+                  The controller repeats the height while idle and sends it every ~50ms while moving. Every publish fans out to
+                        the API / MQTT / recorder so only pass on changes bigger than the hysteresis, no faster than the minimum
+                        interval. loop() forces the final value out once the desk has settled so nothing gets stuck
+                        just short of where the desk actually stopped.
+            */
+            void JarvisCB2CSensor::publish_height_(bool force)
+            {
+                  int32_t tmm = this->current_tmm_;
+                  // The restored height doesn't give the raw sensor anything; let the first report through for it
+                  bool raw_pending = this->raw_height_sensor_ != nullptr && !this->raw_height_sensor_->has_state();
+                  if (tmm == this->published_tmm_ && !raw_pending)
+                        return;
+
+                  if (!force && !raw_pending)
+                  {
+                        if (this->published_tmm_ >= 0 && std::abs(tmm - this->published_tmm_) <= this->publish_hysteresis_tmm_)
+                              return;
+                        if (this->rx_time_ms_ - this->published_ms_ < this->min_publish_interval_ms_)
+                              return;
+                  }
+
+                  this->published_tmm_ = tmm;
+                  this->published_ms_ = this->rx_time_ms_;
+                  if (this->height_sensor_ != nullptr)
+                        this->height_sensor_->publish_state(tmm * .0001f);
+                  if (this->raw_height_sensor_ != nullptr)
+                        this->raw_height_sensor_->publish_state(this->current_pos_);
+                  // Rides along with the height so it's throttled the same way
+                  if (this->velocity_sensor_ != nullptr && this->in_motion_)
+                        this->velocity_sensor_->publish_state(this->velocity_tmm_s_ * .0001f);
+            }
+
+            void JarvisCB2CSensor::motion_changed_(int8_t dir)
+            {
+                  this->motion_dir_ = dir;
+                  if (this->moving_binary_sensor_ != nullptr && !this->moving_binary_sensor_->state)
+                        this->moving_binary_sensor_->publish_state(true);
+                  if (this->direction_text_sensor_ != nullptr)
+                        this->direction_text_sensor_->publish_state(dir > 0 ? "up" : "down");
+            }
+
+            void JarvisCB2CSensor::motion_ended_()
+            {
+                  uint32_t took_ms = this->last_change_ms_ - this->motion_started_ms_;
+                  int32_t moved_tmm = this->current_tmm_ - this->motion_start_tmm_;
+                  ESP_LOGD(this->tag_, "Desk moved %d tmm in %u ms", moved_tmm, took_ms);
+
+                  this->in_motion_ = false;
+                  this->motion_dir_ = 0;
+                  this->preset_pending_ = 0;
+                  this->controller_stop_sent_ = false;
+                  // The controller may go quiet now; don't leave a stale speed behind for stop() / the jog limits to trip over
+                  this->velocity_tmm_s_ = 0;
+                  if (this->velocity_sensor_ != nullptr)
+                        this->velocity_sensor_->publish_state(0);
+                  if (this->moving_binary_sensor_ != nullptr)
+                        this->moving_binary_sensor_->publish_state(false);
+                  if (this->direction_text_sensor_ != nullptr)
+                        this->direction_text_sensor_->publish_state("idle");
+                  if (this->last_move_duration_sensor_ != nullptr)
+                        this->last_move_duration_sensor_->publish_state(took_ms * .001f);
+                  if (this->last_move_distance_sensor_ != nullptr)
+                        this->last_move_distance_sensor_->publish_state(moved_tmm * .0001f);
+                  this->motion_stop_callback_.call(this->current_tmm_ * .0001f);
+            }
+
+            void JarvisCB2CSensor::on_error_(const uint8_t *frame)
+            {
+                  // Shows up on the handset display as E01, E02, ...
+                  char code[8];
+                  snprintf(code, sizeof(code), "E%02u", frame[4]);
+                  ESP_LOGW(this->tag_, "Controller reports error %s", code);
+                  this->abort_motion_();
+                  if (this->error_text_sensor_ != nullptr)
+                        this->error_text_sensor_->publish_state(code);
+                  this->error_callback_.call(code);
+            }
+
+            void JarvisCB2CSensor::on_reset_(const uint8_t *frame)
+            {
+                  // Controller wants a reset (hold DOWN until the desk bottoms out); handset shows RESET
+                  ESP_LOGW(this->tag_, "Controller needs a reset");
+                  this->abort_motion_();
+                  if (this->error_text_sensor_ != nullptr)
+                        this->error_text_sensor_->publish_state("RESET");
+                  this->error_callback_.call("RESET");
+            }
+
+            void JarvisCB2CSensor::on_units_(const uint8_t *frame)
+            {
+                  uint8_t units = frame[4];
+                  if (units != JARVIS_UNITS_CM && units != JARVIS_UNITS_INCH)
+                        return;
+
+                  if (units != this->units_)
+                  {
+                        ESP_LOGD(this->tag_, "units: %s", units == JARVIS_UNITS_INCH ? "in" : "cm");
+                        // Anything measured in the old units is meaningless now; stop and start the estimates over
+                        if (this->units_ != JARVIS_UNITS_UNKNOWN)
+                        {
+                              _stop_and_release_all_buttons();
+                              this->last_report_ms_ = 0;
+                        }
+                        this->units_ = units;
+                  }
+
+                  if (this->units_text_sensor_ != nullptr)
+                        this->units_text_sensor_->publish_state(this->units_ == JARVIS_UNITS_INCH ? "in" : "cm");
+            }
+
+            void JarvisCB2CSensor::on_memory_mode_(const uint8_t *frame)
+            {
+                  if (this->memory_mode_text_sensor_ != nullptr)
+                        this->memory_mode_text_sensor_->publish_state(frame[4] ? "Constant touch" : "One touch");
+            }
+
+            void JarvisCB2CSensor::on_collision_sensitivity_(const uint8_t *frame)
+            {
+                  if (this->collision_sensitivity_text_sensor_ == nullptr)
+                        return;
+
+                  switch (frame[4])
                   {
                   case 1:
-                        /*
-                              command 1: height report packet looks like this:
-
-                                    [0] 0xf2         (242)
-                                    [1] 0xf2         (242)
-                                    [2] 0x1          (1)
-                                    [3] 0x3          (3)
-                                    [4] 0x1          (1)
-                                    [5] 0x97         (151)
-                                    [6] 0x3          (3)
-                                    [7] 0x9f         (159)
-                                    [8] 0x7e         (126)
-
-                              There should be 3 params, the first two are the high/low bytes and the third has unknown purpose
-                              See: https://github.com/phord/Jarvis#height-report
-                        */
-                        uint8_t height_hi = response[4];  // 0x01
-                        uint8_t height_low = response[5]; // 0x97
-
-                        // 0197 is 407 ... and the display says 40.7 on it!
-                        this->current_pos_ = (height_hi << 8) + height_low;
-                        ESP_LOGD(TAG, "height: %d", this->current_pos_);
-
-                        // Raw input will be in tenths of $UNIT. EG 407 -> 40.7 inches
-                        // _to_mm(407) => 1033.78
-                        // 1033.78 * .001 = 1.03378
-                        // We will let ESPHome do the truncation for us; we define 4 decimals of accuracy so
-                        //   the reading will show as 1.0338m in HA. This is human friendly but still has enough
-                        //   precision in it so user can do meter to mm conversion (for whatever reason...) and they'll
-                        //   get something pretty accurate.
-                        this->height_sensor_->publish_state(_to_mm(this->current_pos_) * .001);
+                        this->collision_sensitivity_text_sensor_->publish_state("High");
+                        break;
+                  case 2:
+                        this->collision_sensitivity_text_sensor_->publish_state("Medium");
+                        break;
+                  case 3:
+                        this->collision_sensitivity_text_sensor_->publish_state("Low");
                         break;
                   }
+            }
 
-                  // If goto_height() has been called since we last ran
-                  this->_adjust_height();
+            void JarvisCB2CSensor::on_limits_(const uint8_t *frame)
+            {
+                  // Tells us which of the user limits are set; the heights come in their own frames
+                  this->limits_ = frame[4];
+                  ESP_LOGD(this->tag_, "limits: max %s, min %s", YESNO(this->limits_ & JARVIS_LIMIT_MAX), YESNO(this->limits_ & JARVIS_LIMIT_MIN));
+            }
+
+            void JarvisCB2CSensor::on_limit_height_(const uint8_t *frame)
+            {
+                  int32_t tmm = this->to_tmm_((frame[4] << 8) + frame[5]);
+                  if (frame[2] == JARVIS_CMD_MAX_HEIGHT)
+                        this->max_limit_tmm_ = tmm;
+                  else
+                        this->min_limit_tmm_ = tmm;
+
+                  sensor::Sensor *sens = frame[2] == JARVIS_CMD_MAX_HEIGHT ? this->max_height_sensor_ : this->min_height_sensor_;
+                  if (sens != nullptr)
+                        sens->publish_state(tmm * .0001f);
+            }
+
+            void JarvisCB2CSensor::on_limit_stop_(const uint8_t *frame)
+            {
+                  ESP_LOGD(this->tag_, "Stopped at a height limit (0x%02X)", frame[4]);
+                  if (this->jog_dir_ != 0)
+                        this->jog_limit_dir_ = this->jog_dir_;
+                  this->abort_motion_();
+            }
+
+            // The controller has stopped the desk and won't move it any further; stop pretending we're still getting somewhere
+            void JarvisCB2CSensor::abort_motion_()
+            {
+                  if (this->move_state_ == MOVE_IDLE && this->jog_dir_ == 0)
+                        return;
+                  ESP_LOGD(this->tag_, "Abandoning move at %d tmm", this->current_tmm_);
+                  _stop_and_release_all_buttons();
+            }
+
+            void JarvisCB2CSensor::on_preset_(const uint8_t *frame)
+            {
+                  // Same units as a height report
+                  uint8_t preset = frame[2] - JARVIS_CMD_PRESET_1;
+                  int32_t tmm = this->to_tmm_((frame[4] << 8) + frame[5]);
+                  ESP_LOGD(this->tag_, "preset %u: %d tmm", preset + 1, tmm);
+                  this->preset_tmm_[preset] = tmm;
+                  if (this->preset_sensors_[preset] != nullptr)
+                        this->preset_sensors_[preset]->publish_state(tmm * .0001f);
+            }
+
+            void JarvisCB2CSensor::on_handset_command_(const uint8_t *frame)
+            {
+                  ESP_LOGV(this->tag_, "Handset sent command 0x%02X", frame[2]);
             }
 
             /*
              * Helpers
              */
-            void JarvisCB2CSensor::_adjust_height()
+
+            /*
+                  Track velocity from the timestamped height reports.
+                  The reports are quantized (2.54mm steps on an inch-mode desk) so a single pair of samples is noisy; we smooth them.
+            */
+            void JarvisCB2CSensor::update_motion_(int32_t tmm, uint32_t now)
             {
-                  if (this->target_pos_ == -1)
+                  uint32_t dt = now - this->last_report_ms_;
+                  if (this->last_report_ms_ == 0 || dt >= 1000)
                   {
-                        ESP_LOGD(TAG, "_adjust_height. Nothing to do");
-                        return;
+                        // First report in a while; nothing to compare against
+                        this->velocity_tmm_s_ = 0;
+                  }
+                  else if (dt > 0)
+                  {
+                        int32_t v = (tmm - this->current_tmm_) * 1000 / (int32_t)dt;
+                        this->velocity_tmm_s_ += (v - this->velocity_tmm_s_) >> velocity_shift;
+                        this->report_interval_ms_ += ((int32_t)dt - (int32_t)this->report_interval_ms_) >> velocity_shift;
+                  }
+                  // dt == 0: parsed in the same loop() as the last one (after a stall, say). Keep the estimate we have
+
+                  // The first report after boot (or a units change) is just where the desk is, not a move
+                  if (tmm != this->current_tmm_ && this->last_report_ms_ != 0)
+                  {
+                        this->tx_ack_(TX_ACK_MOTION);
+                        int8_t dir = tmm > this->current_tmm_ ? 1 : -1;
+                        if (!this->in_motion_)
+                        {
+                              // It started moving somewhere between the last report and this one
+                              this->in_motion_ = true;
+                              this->motion_started_ms_ = this->last_report_ms_ != 0 && dt < 1000 ? this->last_report_ms_ : now;
+                              this->motion_start_tmm_ = this->current_tmm_;
+                              this->motion_changed_(dir);
+                              this->motion_start_callback_.call();
+                        }
+                        else if (dir != this->motion_dir_)
+                              this->motion_changed_(dir);
+                        this->last_change_ms_ = now;
+                  }
+
+                  // Furthest we've been past the target, in the direction we set off in
+                  if (this->move_state_ != MOVE_IDLE)
+                  {
+                        int32_t past = (tmm - this->target_tmm_) * this->move_initial_dir_;
+                        if (past > this->move_peak_past_tmm_)
+                              this->move_peak_past_tmm_ = past;
                   }
 
+                  this->current_tmm_ = tmm;
+                  this->last_report_ms_ = now;
+            }
+
+            bool JarvisCB2CSensor::is_stopped_(uint32_t now) const
+            {
+                  // Give the desk a chance to react to whatever we last did before calling it stopped
+                  uint32_t since = this->last_change_ms_;
+                  if ((int32_t)(this->move_state_since_ - since) > 0)
+                        since = this->move_state_since_;
+                  return now - since >= settle_time;
+            }
+
+            void JarvisCB2CSensor::_adjust_height()
+            {
+                  if (this->move_state_ == MOVE_IDLE)
+                        return;
+
                   /*
                         The motor controller has a smooth start/stop that it applies on top of user button presses.
                         This means that we will never have precise control over the exact postion of the desk.
                         We can measure the current height and calculate how far we need to move to get to the
                               correct height... but how long do we hold the button for?
 
-                        I am sure that there's a very complicated way to figure this out involving some heuristics to figure out the acceleration of the desk
-                              and then the derivitive of that. Once the acceleration slows down to a certain point, we can stop pressing the button and let
-                              the soft slow from the motor driver get us the rest of the way. In theory I could do a lot of testing to figure out exactly at
-                              what point I need to let go of the travel button for the desk to finish moving on it's own and arrive at the PRECISE height
-                              that the user asked for.
-
-                        Or I could do something else with my time.
-                        I did some pretty crude testing (read: a few samples in one session) and was within a few mm every time.
+                        The first version of this just held the button until we were within 10mm and let the soft stop
+                              carry the desk the rest of the way. That got within a few mm every time:
                         Request 65.0? get 65.024
                         Request 75.1? get 75.184
                         Request 82.3? get 82.5
 
-                        SO pretty close, all things considered!
+                        Now we estimate the velocity from the height reports and let go of the button once the distance
+                              left is about what the soft stop will coast: v^2 / (2 * decel) plus however far we move before the
+                              next report shows up. The deceleration is re-measured after every release, and if we still miss,
+                              a few short taps on the button clean up the remainder.
                   */
-                  double delta = this->target_pos_ - _to_mm(this->current_pos_);
-                  ESP_LOGD(TAG, "_adjust_height. delta: %.2f", delta);
-                  if (abs(delta) < 10)
+                  uint32_t now = millis();
+                  int32_t pos = this->current_tmm_;
+
+                  if (this->move_state_ == MOVE_DRIVING)
                   {
-                        ESP_LOGD(TAG, "_adjust_height. Close enough... not moving!");
+                        // The controller stopped us (collision, a limit, an error) or the reports dried up. Either way holding
+                        //    the button any longer won't get us there
+                        if (this->is_stopped_(now) || now - this->move_state_since_ >= max_drive_time)
+                        {
+                              ESP_LOGW(this->tag_, "_adjust_height. desk stopped at %d tmm short of %d tmm, giving up", pos, this->target_tmm_);
+                              _stop_and_release_all_buttons();
+                              return;
+                        }
+
+                        // Distance still to go in the direction of travel; negative once we've passed the target
+                        int32_t remaining = (this->target_tmm_ - pos) * this->move_dir_;
+                        int32_t v = std::abs(this->velocity_tmm_s_);
+                        uint8_t d = this->move_dir_ > 0 ? MOTION_UP : MOTION_DOWN;
+                        int32_t coast = (v * v) / (2 * this->model_.decel_tmm_s2[d]) + v * (int32_t)this->report_interval_ms_ / 1000 +
+                                        this->model_.overshoot_tmm[d];
+                        if (remaining > coast)
+                              return;
+
+                        ESP_LOGD(this->tag_, "_adjust_height. releasing at %d, v: %d tmm/s, predicted coast: %d tmm", pos, v, coast);
+                        this->trace_->record_decision(micros(), DECISION_RELEASE, pos, this->trace_source_);
+                        this->write_chord_(BTN_ALL, false);
+                        this->release_tmm_ = pos;
+                        this->release_velocity_tmm_s_ = v;
+                        this->move_state_ = MOVE_SETTLING;
+                        this->move_state_since_ = now;
+                        return;
+                  }
+
+                  // MOVE_SETTLING; wait for any nudge to finish and for the desk to stop before judging where we ended up
+                  if (this->btn_count_ != 0 || !this->is_stopped_(now))
+                        return;
+
+                  this->settle_();
+            }
+
+            void JarvisCB2CSensor::settle_()
+            {
+                  // The first time we settle after a full press tells us how good the release point was
+                  if (this->release_velocity_tmm_s_ > 50)
+                  {
+                        this->learn_from_move_();
+                        this->release_velocity_tmm_s_ = 0;
+                  }
+
+                  if (this->nudge_press_ms_ != 0)
+                        this->learn_from_nudge_();
+
+                  int32_t delta = this->target_tmm_ - this->current_tmm_;
+                  if (std::abs(delta) <= target_tolerance_tmm || this->nudges_ >= max_nudges)
+                  {
+                        this->trace_->record_decision(micros(), DECISION_DONE, -delta, this->trace_source_);
+                        this->finish_move_();
                         _stop_and_release_all_buttons();
-                        // Indicate that there's nothing to do
-                        this->target_pos_ = -1;
+                        // Last, with the move fully wound down, so an automation can start the next one from in here.
+                        //    Only if we actually got there; running out of nudges isn't reaching the height
+                        if (std::abs(delta) <= target_tolerance_tmm)
+                              this->height_reached_callback_.call(this->current_tmm_ * .0001f);
                         return;
                   }
 
+                  // Close, but not close enough. Tap the button and check again once the desk stops
+                  int8_t dir = delta > 0 ? 1 : -1;
+                  if (dir != this->move_dir_)
+                        this->move_reversals_++;
+                  this->move_dir_ = dir;
+                  this->nudges_++;
+                  this->nudge_press_ms_ = this->nudge_press_for_(delta);
+                  this->nudge_from_tmm_ = this->current_tmm_;
+                  ESP_LOGD(this->tag_, "_adjust_height. off by %d tmm, nudge %u for %u ms", delta, this->nudges_, this->nudge_press_ms_);
+                  this->trace_->record_decision(micros(), DECISION_NUDGE, -delta, this->trace_source_);
+                  this->queue_press_(this->move_dir_ > 0 ? BTN_UP : BTN_DOWN, this->nudge_press_ms_);
+                  this->move_state_since_ = millis();
+            }
+
+            /*
+                  How long to press to cover $delta.
+                  Inside the soft start the distance goes with the square of the press, so scale the last nudge that moved the
+                        desk by the square root of how much further we need to go this time.
+            */
+            uint16_t JarvisCB2CSensor::nudge_press_for_(int32_t delta) const
+            {
+                  uint8_t d = delta > 0 ? MOTION_UP : MOTION_DOWN;
+                  if (this->model_.nudge_tmm[d] <= 0)
+                        return this->model_.nudge_ms[d];
+                  float scale = sqrtf((float)std::abs(delta) / this->model_.nudge_tmm[d]);
+                  return clamp((int)lroundf(this->model_.nudge_ms[d] * scale), nudge_time, nudge_max_time);
+            }
+
+            void JarvisCB2CSensor::learn_from_nudge_()
+            {
+                  uint8_t d = this->move_dir_ > 0 ? MOTION_UP : MOTION_DOWN;
+                  int32_t moved = (this->current_tmm_ - this->nudge_from_tmm_) * this->move_dir_;
+                  if (moved > 0)
+                  {
+                        this->model_.nudge_ms[d] = this->nudge_press_ms_;
+                        this->model_.nudge_tmm[d] = moved;
+                  }
+                  else
+                  {
+                        // Didn't get past the soft start, or not far enough to show up in a report. Press for longer next time,
+                        //    and don't hold it against this move unless we're already pressing as long as a nudge can be
+                        this->model_.nudge_ms[d] = clamp(this->nudge_press_ms_ * 3 / 2, nudge_time, nudge_max_time);
+                        this->model_.nudge_tmm[d] = 0;
+                        if (this->nudge_press_ms_ < nudge_max_time)
+                              this->nudges_--;
+                  }
+                  ESP_LOGD(this->tag_, "_adjust_height. %u ms nudge moved %d tmm; %s nudge now %u ms", this->nudge_press_ms_, moved,
+                           d == MOTION_UP ? "up" : "down", this->model_.nudge_ms[d]);
+                  this->nudge_press_ms_ = 0;
+                  this->model_pref_.save(&this->model_);
+            }
+
+            /*
+                  Record how the move went so controller changes can be judged on numbers rather than feel:
+                        time from goto_height() until the desk stopped for the last time, how far past the target it got and
+                        how many times we had to change direction to get there.
+            */
+            void JarvisCB2CSensor::finish_move_()
+            {
+                  uint32_t took_ms = 0;
+                  if ((int32_t)(this->last_change_ms_ - this->move_started_ms_) > 0)
+                        took_ms = this->last_change_ms_ - this->move_started_ms_;
+                  int32_t error = this->current_tmm_ - this->target_tmm_;
+
+                  this->move_stats_.moves++;
+                  this->move_stats_.total_ms += took_ms;
+                  this->move_stats_.total_abs_error_tmm += std::abs(error);
+                  this->move_stats_.reversals += this->move_reversals_;
+                  if (this->move_peak_past_tmm_ > this->move_stats_.max_overshoot_tmm)
+                        this->move_stats_.max_overshoot_tmm = this->move_peak_past_tmm_;
+
+                  ESP_LOGI(this->tag_, "Move %.1f -> %.1f mm: ended at %.1f (error %.1f mm) in %u ms, overshoot %.1f mm, %u nudges, %u reversals",
+                           this->move_start_tmm_ * .1f, this->target_tmm_ * .1f, this->current_tmm_ * .1f, error * .1f, took_ms,
+                           this->move_peak_past_tmm_ * .1f, this->nudges_, this->move_reversals_);
+
+                  if (this->time_to_target_sensor_ != nullptr)
+                        this->time_to_target_sensor_->publish_state(took_ms * .001f);
+                  if (this->target_error_sensor_ != nullptr)
+                        this->target_error_sensor_->publish_state(error * .0001f);
+            }
+
+            /*
+                  Fold a finished move into the model for that direction.
+                  Deceleration comes from how far we coasted after letting go at a known velocity. Whatever error is left over
+                        (report latency, the button being sampled late, ...) goes into the overshoot correction.
+            */
+            void JarvisCB2CSensor::learn_from_move_()
+            {
+                  uint8_t d = this->move_dir_ > 0 ? MOTION_UP : MOTION_DOWN;
+                  uint16_t n = this->model_.samples[d] < model_window ? this->model_.samples[d] + 1 : model_window;
+
+                  int32_t coasted = (this->current_tmm_ - this->release_tmm_) * this->move_dir_;
+                  if (coasted > 5)
+                  {
+                        int32_t observed = (this->release_velocity_tmm_s_ * this->release_velocity_tmm_s_) / (2 * coasted);
+                        this->model_.decel_tmm_s2[d] += (observed - this->model_.decel_tmm_s2[d]) / n;
+                  }
+
+                  int32_t overshoot = (this->current_tmm_ - this->target_tmm_) * this->move_dir_;
+                  this->model_.overshoot_tmm[d] = clamp(this->model_.overshoot_tmm[d] + overshoot / 2, -max_overshoot_tmm, max_overshoot_tmm);
+                  this->model_.samples[d] = n;
+
+                  ESP_LOGD(this->tag_, "_adjust_height. coasted %d tmm, overshot %d tmm; %s decel now %d tmm/s^2, correction %d tmm",
+                           coasted, overshoot, d == MOTION_UP ? "up" : "down", this->model_.decel_tmm_s2[d], this->model_.overshoot_tmm[d]);
+                  this->model_pref_.save(&this->model_);
+            }
+
+            void JarvisCB2CSensor::start_drive_(int8_t dir)
+            {
+                  this->move_dir_ = dir;
+                  this->move_state_ = MOVE_DRIVING;
+                  this->move_state_since_ = millis();
                   // Desk needs to up
-                  if (delta > 0)
+                  if (dir > 0)
                   {
-                        ESP_LOGD(TAG, "DESK UP!");
-                        if (this->hc1_pin != nullptr)
-                              this->hc1_pin->digital_write(false);
+                        ESP_LOGD(this->tag_, "DESK UP!");
+                        this->write_chord_(BTN_UP, true);
                   }
-                  else if (delta < 0)
+                  else
                   {
-                        ESP_LOGD(TAG, "DESK DOWN!");
-                        if (this->hc0_pin != nullptr)
-                              this->hc0_pin->digital_write(false);
+                        ESP_LOGD(this->tag_, "DESK DOWN!");
+                        this->write_chord_(BTN_DOWN, true);
                   }
             }
 
@@ -208,128 +944,265 @@ namespace esphome
                   // The 3 stage model goes from 24.5 inches to 50 inches (without top) which is 62-127cm
                   if ((int)ht_in_cm < 62. || (int)ht_in_cm > 127)
                   {
-                        ESP_LOGE(TAG, "Can't go to requested height as it's out of bounds. h: %.2f", ht_in_cm);
+                        ESP_LOGE(this->tag_, "Can't go to requested height as it's out of bounds. h: %.2f", ht_in_cm);
+                        return;
+                  }
+                  // Without a restored or reported height there's nothing to measure the move against
+                  if (!this->height_reported_ && this->current_tmm_ <= 0)
+                  {
+                        ESP_LOGE(this->tag_, "Can't go to requested height until the controller has reported where the desk is");
                         return;
                   }
-                  ESP_LOGD(TAG, "goto_height. 1 requested height of: %.1f (cm). Currently at (uint16) %u ", ht_in_cm, this->current_pos_);
 
-                  float current_height_in_mm = _to_mm(this->current_pos_);
-                  ESP_LOGD(TAG, "goto_height. current_height_in_mm: %.2f", current_height_in_mm);
+                  // Everything past this point is in tenths of a mm
+                  int32_t desired_tmm = lround(ht_in_cm * 100);
 
-                  double desired_ht_in_mm = ht_in_cm * 10;
-                  ESP_LOGD(TAG, "goto_height. desired_ht_in_mm: %.2f", desired_ht_in_mm);
+                  // The controller won't go past a user limit, so don't ask it to
+                  if ((this->limits_ & JARVIS_LIMIT_MAX) && this->max_limit_tmm_ > 0 && desired_tmm > this->max_limit_tmm_)
+                  {
+                        ESP_LOGD(this->tag_, "goto_height. %d tmm is above the upper limit, going to %d tmm", desired_tmm, this->max_limit_tmm_);
+                        desired_tmm = this->max_limit_tmm_;
+                  }
+                  if ((this->limits_ & JARVIS_LIMIT_MIN) && this->min_limit_tmm_ > 0 && desired_tmm < this->min_limit_tmm_)
+                  {
+                        ESP_LOGD(this->tag_, "goto_height. %d tmm is below the lower limit, going to %d tmm", desired_tmm, this->min_limit_tmm_);
+                        desired_tmm = this->min_limit_tmm_;
+                  }
+                  ESP_LOGD(this->tag_, "goto_height. requested height of: %.1f (cm). Currently at %d tmm", ht_in_cm, this->current_tmm_);
 
-                  if (current_height_in_mm == desired_ht_in_mm)
+                  int32_t delta = desired_tmm - this->current_tmm_;
+                  if (std::abs(delta) <= target_tolerance_tmm)
                   {
-                        ESP_LOGD(TAG, "requested height and current height match. Nothing to do.");
+                        ESP_LOGD(this->tag_, "requested height and current height match. Nothing to do.");
                         return;
                   }
+
+                  // If we were already on the way somewhere else, let go first
+                  _stop_and_release_all_buttons();
+
                   // Otherwise, record the new desired position, we will do the movement on loop()
-                  this->target_pos_ = desired_ht_in_mm;
-                  ESP_LOGD(TAG, "goto_height. target_pos_: %.2f", this->target_pos_);
+                  this->target_tmm_ = desired_tmm;
+                  this->nudges_ = 0;
+                  this->release_velocity_tmm_s_ = 0;
+                  this->nudge_press_ms_ = 0;
+
+                  this->move_started_ms_ = millis();
+                  this->move_start_tmm_ = this->current_tmm_;
+                  this->move_initial_dir_ = delta > 0 ? 1 : -1;
+                  this->move_peak_past_tmm_ = 0;
+                  this->move_reversals_ = 0;
+                  this->trace_->record_decision(micros(), DECISION_START, desired_tmm, this->trace_source_);
+
+                  if (std::abs(delta) < nudge_zone_tmm)
+                  {
+                        // Not worth a full press; let the settle logic tap us there
+                        this->move_dir_ = delta > 0 ? 1 : -1;
+                        this->move_state_ = MOVE_SETTLING;
+                        this->move_state_since_ = millis() - settle_time;
+                        return;
+                  }
+
+                  this->start_drive_(delta > 0 ? 1 : -1);
+            }
+
+            void JarvisCB2CSensor::stop()
+            {
+                  this->cancel_sequence();
+                  this->halt_motion_();
             }
 
             void JarvisCB2CSensor::goto_preset(int p)
             {
-                  if (!p || p > 4)
+                  if (p < 1 || p > 4)
                   {
-                        ESP_LOGE(TAG, "Called with invalid preset number: %i", p);
+                        ESP_LOGE(this->tag_, "Called with invalid preset number: %i", p);
+                        return;
                   }
 
                   // If desk was in the process of moving to a height, stop moving
                   _stop_and_release_all_buttons();
+                  this->preset_pending_ = p;
+                  this->preset_pending_since_ms_ = millis();
+                  this->controller_stop_sent_ = false;
+
+                  // The controller repeats the height while idle too, so only a height that has changed says the MOVE got through
+                  if (this->serial_commands_)
+                        this->queue_frame_(FRAME_MOVE[p - 1], TX_ACK_MOTION);
+                  else
+                        this->queue_press_(PRESET_CHORDS[p - 1], btn_delay_time);
+            }
 
-                  switch (p)
+            // Save the current height to preset $p
+            void JarvisCB2CSensor::program_preset(int p)
+            {
+                  if (p < 1 || p > 4)
                   {
-                  case 1:
-                        if (this->hc0_pin != nullptr)
-                              this->hc0_pin->digital_write(false);
+                        ESP_LOGE(this->tag_, "Called with invalid preset number: %i", p);
+                        return;
+                  }
 
-                        if (this->hc1_pin != nullptr)
-                              this->hc1_pin->digital_write(false);
+                  _stop_and_release_all_buttons();
+
+                  // The controller reports the new preset height back to us once it's stored
+                  if (this->serial_commands_)
+                  {
+                        this->queue_frame_(FRAME_PROGMEM[p - 1], JARVIS_CMD_PRESET_1 + p - 1);
+                        return;
+                  }
 
-                        delay(btn_delay_time);
+                  // Same as doing it by hand: M, then the preset
+                  this->queue_press_(BTN_M, m_btn_delay_time);
+                  this->queue_press_(PRESET_CHORDS[p - 1], btn_delay_time);
+            }
 
-                        if (this->hc0_pin != nullptr)
-                              this->hc0_pin->digital_write(true);
+            void JarvisCB2CSensor::change_units(bool inches)
+            {
+                  // There's no button combination for this, it's a serial only setting. Controller confirms with a UNITS report
+                  this->queue_frame_(inches ? FRAME_UNITS_INCH : FRAME_UNITS_CM, JARVIS_CMD_UNITS);
+            }
 
-                        if (this->hc1_pin != nullptr)
-                              this->hc1_pin->digital_write(true);
-                        break;
-                  case 2:
-                        if (this->hc2_pin != nullptr)
-                              this->hc2_pin->digital_write(false);
+            void JarvisCB2CSensor::do_wake()
+            {
+                  ESP_LOGD(this->tag_, "doing wake");
+                  this->queue_frame_(FRAME_WAKE, TX_NO_ACK);
+            }
 
-                        delay(btn_delay_time);
+            /*
+                  Serial transmit.
+                  Frames are queued and go out one at a time from loop(), at least tx_gap_time apart. Anything that expects a
+                        response from the controller is held at the head of the queue (and re-sent every tx_ack_timeout) until that
+                        response shows up or we give up.
+            */
+            bool JarvisCB2CSensor::queue_frame_(const TxFrame &frame, uint8_t ack_cmd)
+            {
+                  if (this->tx_count_ == TX_QUEUE_LEN)
+                  {
+                        ESP_LOGW(this->tag_, "TX queue is full, dropping command 0x%02X", frame.data[2]);
+                        return false;
+                  }
 
-                        if (this->hc2_pin != nullptr)
-                              this->hc2_pin->digital_write(true);
-                        break;
-                  case 3:
-                        if (this->hc2_pin != nullptr)
-                              this->hc2_pin->digital_write(false);
-                        if (this->hc0_pin != nullptr)
-                              this->hc0_pin->digital_write(false);
+                  TxRequest &req = this->tx_queue_[(this->tx_head_ + this->tx_count_) % TX_QUEUE_LEN];
+                  req.frame = &frame;
+                  req.ack_cmd = ack_cmd;
+                  req.tries = 0;
+                  this->tx_count_++;
 
-                        delay(btn_delay_time);
+                  this->service_tx_();
+                  return true;
+            }
 
-                        if (this->hc2_pin != nullptr)
-                              this->hc2_pin->digital_write(true);
-                        if (this->hc0_pin != nullptr)
-                              this->hc0_pin->digital_write(true);
+            void JarvisCB2CSensor::service_tx_()
+            {
+                  if (this->tx_count_ == 0)
+                        return;
 
-                        break;
-                  case 4:
-                        if (this->hc2_pin != nullptr)
-                              this->hc2_pin->digital_write(false);
+                  uint32_t now = millis();
+                  TxRequest &req = this->tx_queue_[this->tx_head_];
 
-                        if (this->hc1_pin != nullptr)
-                              this->hc1_pin->digital_write(false);
+                  if (this->tx_in_flight_)
+                  {
+                        if (now - this->tx_last_sent_ms_ < tx_ack_timeout)
+                              return;
 
-                        delay(btn_delay_time);
+                        if (req.tries >= tx_max_tries)
+                        {
+                              ESP_LOGW(this->tag_, "No response to command 0x%02X after %u tries", req.frame->data[2], req.tries);
+                              this->tx_in_flight_ = false;
+                              this->tx_head_ = (this->tx_head_ + 1) % TX_QUEUE_LEN;
+                              this->tx_count_--;
+                              return;
+                        }
+                  }
+                  else if (now - this->tx_last_sent_ms_ < tx_gap_time)
+                  {
+                        return;
+                  }
 
-                        if (this->hc2_pin != nullptr)
-                              this->hc2_pin->digital_write(true);
-                        if (this->hc1_pin != nullptr)
-                              this->hc1_pin->digital_write(true);
+                  this->write_array(req.frame->data, req.frame->len);
+                  this->trace_->record(micros(), TRACE_TX_FRAME | this->trace_source_, req.frame->data, req.frame->len);
+                  req.tries++;
+                  this->tx_last_sent_ms_ = now;
 
-                        break;
+                  if (req.ack_cmd != TX_NO_ACK)
+                  {
+                        this->tx_in_flight_ = true;
+                        return;
                   }
+                  this->tx_head_ = (this->tx_head_ + 1) % TX_QUEUE_LEN;
+                  this->tx_count_--;
             }
 
-            void JarvisCB2CSensor::do_wake()
+            void JarvisCB2CSensor::tx_ack_(uint8_t cmd)
             {
-                  ESP_LOGD(TAG, "doing wake");
-                  uint8_t pkt[] = {
-                      0xF1, // address of motor
-                      0xF1, // address of motor
-                      0x29, // WAKE command
-                      0x0,  // 0 params
-                      0x29, // checksum of 0x29+0 is ... 0x29 :)
-                      0x7e  // end of message
-                  };
-                  this->write_array(pkt, 6);
+                  if (!this->tx_in_flight_ || this->tx_queue_[this->tx_head_].ack_cmd != cmd)
+                        return;
+
+                  ESP_LOGV(this->tag_, "Command 0x%02X acknowledged", this->tx_queue_[this->tx_head_].frame->data[2]);
+                  this->tx_in_flight_ = false;
+                  this->tx_head_ = (this->tx_head_ + 1) % TX_QUEUE_LEN;
+                  this->tx_count_--;
+            }
+
+            void JarvisCB2CSensor::drop_queued_motion_()
+            {
+                  uint8_t kept = 0;
+                  for (uint8_t i = 0; i < this->tx_count_; i++)
+                  {
+                        const TxRequest &req = this->tx_queue_[(this->tx_head_ + i) % TX_QUEUE_LEN];
+                        bool motion = (req.frame >= FRAME_MOVE && req.frame < FRAME_MOVE + 4) ||
+                                      (req.frame >= FRAME_PROGMEM && req.frame < FRAME_PROGMEM + 4);
+                        if (motion)
+                        {
+                              ESP_LOGV(this->tag_, "Dropping queued command 0x%02X", req.frame->data[2]);
+                              // The head was the one waiting on an ack; whatever is next goes out fresh
+                              if (i == 0)
+                                    this->tx_in_flight_ = false;
+                              continue;
+                        }
+                        this->tx_queue_[(this->tx_head_ + kept) % TX_QUEUE_LEN] = req;
+                        kept++;
+                  }
+                  this->tx_count_ = kept;
             }
 
             void JarvisCB2CSensor::_stop_and_release_all_buttons()
             {
-                  ESP_LOGD(TAG, "Stop All!");
-                  this->target_pos_ = -1;
+                  ESP_LOGD(this->tag_, "Stop All!");
+                  this->trace_->record_decision(micros(), DECISION_STOP, this->target_tmm_, this->trace_source_);
+                  this->target_tmm_ = -1;
+                  this->move_state_ = MOVE_IDLE;
+                  this->jog_dir_ = 0;
+
+                  // Drop anything that was still waiting to be pressed
+                  this->btn_count_ = 0;
+                  this->btn_pressed_ = false;
+                  this->drop_queued_motion_();
 
-                  // GPIO are active low, idle high
-                  if (this->hc0_pin != nullptr)
-                        this->hc0_pin->digital_write(true);
-                  if (this->hc1_pin != nullptr)
-                        this->hc1_pin->digital_write(true);
-                  if (this->hc2_pin != nullptr)
-                        this->hc2_pin->digital_write(true);
-                  if (this->hc3_pin != nullptr)
-                        this->hc3_pin->digital_write(true);
+                  this->write_chord_(BTN_ALL, false);
+            }
+
+            void JarvisCB2CSensor::halt_motion_()
+            {
+                  // Preset recalls are driven by the controller; any button stops them. Tap the opposite way so there's no
+                  //    chance of it being read as something else. Not if it's already stopped though, that would move it
+                  bool controller_moving = this->move_state_ == MOVE_IDLE && this->jog_dir_ == 0 && !this->controller_stop_sent_ &&
+                                           (this->in_motion_ || this->preset_pending_ != 0);
+                  int8_t dir = this->motion_dir_;
+                  // Asked for a preset but no height change yet; it's heading for the preset, if we know where that is
+                  if (dir == 0 && this->preset_pending_ != 0 && this->preset_tmm_[this->preset_pending_ - 1] >= 0)
+                        dir = this->preset_tmm_[this->preset_pending_ - 1] > this->current_tmm_ ? 1 : -1;
+
+                  _stop_and_release_all_buttons();
+                  this->preset_pending_ = 0;
+                  if (!controller_moving)
+                        return;
+                  this->queue_press_(dir > 0 ? BTN_DOWN : BTN_UP, nudge_time);
+                  this->controller_stop_sent_ = true;
             }
 
             void JarvisCB2CSensor::do_null()
             {
-                  ESP_LOGD(TAG, "doing null wake");
+                  ESP_LOGD(this->tag_, "doing null wake");
                   uint8_t pkt[] = {
                       0x00};
                   this->write_array(pkt, 1);
@@ -337,101 +1210,571 @@ namespace esphome
 
             void JarvisCB2CSensor::do_m()
             {
-                  ESP_LOGD(TAG, "doing m button press");
-                  if (this->hc3_pin != nullptr)
-                        this->hc3_pin->digital_write(false);
-                  if (this->hc0_pin != nullptr)
-                        this->hc0_pin->digital_write(false);
-                  delay(100);
-                  if (this->hc3_pin != nullptr)
-                        this->hc3_pin->digital_write(true);
-                  if (this->hc0_pin != nullptr)
-                        this->hc0_pin->digital_write(true);
+                  ESP_LOGD(this->tag_, "doing m button press");
+                  this->queue_press_(BTN_M, m_btn_delay_time);
             }
 
-            // TODO: almost certainly want to but a max timeout in here
-            // What happens if I click the UP button and then HA crashes? I
             void JarvisCB2CSensor::do_manual_move(char direction)
             {
-                  switch (direction)
+                  int8_t dir = direction == 'u' ? 1 : direction == 'd' ? -1 : 0;
+                  if (dir == 0)
                   {
-                  case 'u':
-                        ESP_LOGD(TAG, "manual move up");
-                        break;
+                        this->jog_limit_dir_ = 0;
+                        if (this->jog_dir_ != 0)
+                              _stop_and_release_all_buttons();
+                        return;
+                  }
 
-                  case 'd':
-                        ESP_LOGD(TAG, "manual move down");
-                        break;
+                  // Stopped at a limit going this way; keepalives for the same direction don't start it again until the
+                  //    button is let go or the direction changes. Otherwise every keepalive would creep it a bit further
+                  if (dir == this->jog_limit_dir_)
+                        return;
+                  this->jog_limit_dir_ = 0;
+
+                  this->jog_keepalive_ms_ = millis();
+                  if (dir == this->jog_dir_)
+                        return;
+
+                  // Starting, or turning around. Drop whatever else was going on first
+                  ESP_LOGD(this->tag_, "manual move %s", dir > 0 ? "up" : "down");
+                  this->cancel_sequence();
+                  _stop_and_release_all_buttons();
+                  this->jog_dir_ = dir;
+                  this->write_chord_(dir > 0 ? BTN_UP : BTN_DOWN, true);
+            }
+
+            /*
+                  Let go of a jog once the keepalives stop, or once the desk would coast past a limit if we let go any later.
+                  Runs first thing in every loop(), which is spinning flat out while a jog is held, so the button is released
+                        within a loop() iteration of the deadline whatever the network is doing.
+            */
+            void JarvisCB2CSensor::service_jog_(uint32_t now)
+            {
+                  if (this->jog_dir_ == 0)
+                        return;
+
+                  uint32_t since = now - this->jog_keepalive_ms_;
+                  if (since >= this->jog_timeout_ms_)
+                  {
+                        if (since > this->jog_max_latency_ms_)
+                              this->jog_max_latency_ms_ = since;
+                        this->jog_timeouts_++;
+                        ESP_LOGD(this->tag_, "manual move: no keepalive for %u ms, stopping", since);
+                        _stop_and_release_all_buttons();
+                        return;
+                  }
+
+                  // Same limits goto_height() accepts, narrowed by the user limits if there are any
+                  int32_t max_tmm = 12700;
+                  int32_t min_tmm = 6200;
+                  if ((this->limits_ & JARVIS_LIMIT_MAX) && this->max_limit_tmm_ < max_tmm)
+                        max_tmm = this->max_limit_tmm_;
+                  if ((this->limits_ & JARVIS_LIMIT_MIN) && this->min_limit_tmm_ > min_tmm)
+                        min_tmm = this->min_limit_tmm_;
+
+                  // Leave room for the soft stop
+                  int32_t v = std::abs(this->velocity_tmm_s_);
+                  uint8_t d = this->jog_dir_ > 0 ? MOTION_UP : MOTION_DOWN;
+                  int32_t coast = (v * v) / (2 * this->model_.decel_tmm_s2[d]);
+                  int32_t pos = this->current_tmm_;
+                  if ((this->jog_dir_ > 0 && pos + coast >= max_tmm) || (this->jog_dir_ < 0 && pos - coast <= min_tmm))
+                  {
+                        ESP_LOGD(this->tag_, "manual move: stopping at %d tmm for the %s limit", pos, this->jog_dir_ > 0 ? "upper" : "lower");
+                        this->jog_limit_dir_ = this->jog_dir_;
+                        _stop_and_release_all_buttons();
+                  }
+            }
+
+            /*
+                  Timed button presses.
+                  The remote signals a button press by holding one or more lines low for ~150ms. Rather than delay() for that long
+                        in the main loop, we assert the lines, note when they should be released and let loop() take care of the rest.
+            */
+            bool JarvisCB2CSensor::queue_press_(uint8_t chord, uint16_t duration_ms)
+            {
+                  if (this->btn_count_ == BTN_QUEUE_LEN)
+                  {
+                        ESP_LOGW(this->tag_, "Button queue is full, dropping press of 0x%x", chord);
+                        return false;
+                  }
+
+                  uint8_t tail = (this->btn_head_ + this->btn_count_) % BTN_QUEUE_LEN;
+                  this->btn_queue_[tail].chord = chord;
+                  this->btn_queue_[tail].duration_ms = duration_ms;
+                  this->btn_count_++;
+
+                  // If nothing else is being pressed, this starts the press right away
+                  this->service_buttons_();
+                  return true;
+            }
+
+            void JarvisCB2CSensor::service_buttons_()
+            {
+                  if (this->btn_count_ == 0)
+                        return;
+
+                  uint32_t now = millis();
+                  ButtonAction &action = this->btn_queue_[this->btn_head_];
+
+                  if (this->btn_pressed_)
+                  {
+                        if ((int32_t)(now - this->btn_release_at_) < 0)
+                              return;
+
+                        this->write_chord_(action.chord, false);
+                        this->btn_pressed_ = false;
+                        this->btn_head_ = (this->btn_head_ + 1) % BTN_QUEUE_LEN;
+                        this->btn_count_--;
+                        this->btn_next_at_ = now + btn_gap_time;
+                        return;
                   }
+
+                  if ((int32_t)(now - this->btn_next_at_) < 0)
+                        return;
+
+                  this->write_chord_(action.chord, true);
+                  this->btn_pressed_ = true;
+                  this->btn_release_at_ = now + action.duration_ms;
+            }
+
+            /*
+                  Chords go out through the GPIO set / clear registers. Pressing PRESET 1 as two digital_write() calls leaves a few us
+                        where the controller sees only hc0 (DOWN) and the desk twitches; a single register write moves both lines at
+                        once. Works out where each configured pin lives once here so write_chord_() is just the writes.
+            */
+            static bool direct_gpio(GPIOPin *pin, uint8_t &bank, uint32_t &bit, bool &inverted)
+            {
+#if defined(USE_ESP32) || defined(USE_ESP8266)
+                  if (!pin->is_internal())
+                        return false;
+                  InternalGPIOPin *internal = static_cast<InternalGPIOPin *>(pin);
+                  uint8_t num = internal->get_pin();
+                  inverted = internal->is_inverted();
+#ifdef USE_ESP32
+                  if (num >= 32 * GPIO_BANKS)
+                        return false;
+#else
+                  // GPIO16 is in the RTC block, not the GPIO registers
+                  if (num > 15)
+                        return false;
+#endif
+                  bank = num / 32;
+                  bit = 1UL << (num % 32);
+                  return true;
+#else
+                  return false;
+#endif
             }
 
-            float JarvisCB2CSensor::_to_mm(int16_t h)
+            static inline void write_gpio_bank(uint8_t bank, uint32_t set, uint32_t clear)
             {
+#if defined(USE_ESP32)
+                  if (bank == 0)
+                  {
+                        if (set)
+                              REG_WRITE(GPIO_OUT_W1TS_REG, set);
+                        if (clear)
+                              REG_WRITE(GPIO_OUT_W1TC_REG, clear);
+                  }
+#ifdef GPIO_OUT1_W1TS_REG
+                  else
+                  {
+                        if (set)
+                              REG_WRITE(GPIO_OUT1_W1TS_REG, set);
+                        if (clear)
+                              REG_WRITE(GPIO_OUT1_W1TC_REG, clear);
+                  }
+#endif
+#elif defined(USE_ESP8266)
+                  if (set)
+                        GPOS = set;
+                  if (clear)
+                        GPOC = clear;
+#endif
+            }
+
+            void JarvisCB2CSensor::build_chord_masks_()
+            {
+                  GPIOPin *pins[] = {this->hc0_pin, this->hc1_pin, this->hc2_pin, this->hc3_pin};
+                  for (uint8_t i = 0; i < 4; i++)
+                  {
+                        if (pins[i] == nullptr)
+                              continue;
+                        pins[i]->setup();
+
+                        uint8_t bank;
+                        uint32_t bit;
+                        bool inverted;
+                        if (!direct_gpio(pins[i], bank, bit, inverted))
+                        {
+                              ESP_LOGD(this->tag_, "Setup: hc%u can't be written directly, chords using it may not be atomic", i);
+                              this->slow_pins_ |= 1 << i;
+                              continue;
+                        }
+
+                        // Pressed is low, unless the pin is inverted
+                        for (uint8_t chord = 1; chord <= BTN_ALL; chord++)
+                        {
+                              if (!(chord & (1 << i)))
+                                    continue;
+                              if (inverted)
+                                    this->chord_masks_[chord].high[bank] |= bit;
+                              else
+                                    this->chord_masks_[chord].low[bank] |= bit;
+                        }
+                  }
 
-                  float conv = 0;
                   /*
-                        TODO: I should probably send the bytes to the controller to ask it which units it's configured with.
-                        From testing, though, desk controller seems to report these values::
-                              Height from 240..530 is in inches
-                              Height from 650..1290 is in mm
+                        A chord is only atomic if it comes down to one register write. Mixing inverted and plain pins needs a set and
+                              a clear, pins in both banks need a write per bank, and expander pins go one at a time after all of those.
                   */
-                  if (h < 600)
+                  uint8_t configured = 0;
+                  for (uint8_t i = 0; i < 4; i++)
+                        if (pins[i] != nullptr)
+                              configured |= 1 << i;
+                  for (uint8_t chord = 1; chord <= BTN_ALL; chord++)
+                  {
+                        if ((chord & configured) != chord)
+                              continue;
+                        const ChordMask &mask = this->chord_masks_[chord];
+                        uint8_t writes = 0;
+                        for (uint8_t bank = 0; bank < GPIO_BANKS; bank++)
+                              writes += (mask.low[bank] != 0) + (mask.high[bank] != 0);
+                        for (uint8_t i = 0; i < 4; i++)
+                              writes += (chord & this->slow_pins_ & (1 << i)) != 0;
+                        if (writes > 1)
+                        {
+                              ESP_LOGD(this->tag_, "Setup: chord 0x%X takes %u writes, it won't be atomic", chord, writes);
+                              this->split_chords_++;
+                        }
+                  }
+            }
+
+            void JarvisCB2CSensor::write_chord_(uint8_t chord, bool pressed)
+            {
+                  uint8_t edge[2] = {chord, pressed};
+                  this->trace_->record(micros(), TRACE_PINS | this->trace_source_, edge, sizeof(edge));
+
+                  const ChordMask &mask = this->chord_masks_[chord & BTN_ALL];
+                  for (uint8_t bank = 0; bank < GPIO_BANKS; bank++)
+                  {
+                        if (pressed)
+                              write_gpio_bank(bank, mask.high[bank], mask.low[bank]);
+                        else
+                              write_gpio_bank(bank, mask.low[bank], mask.high[bank]);
+                  }
+
+                  // Anything left has to go one pin at a time. GPIO are active low, idle high
+                  chord &= this->slow_pins_;
+                  if ((chord & BTN_HC0) && this->hc0_pin != nullptr)
+                        this->hc0_pin->digital_write(!pressed);
+                  if ((chord & BTN_HC1) && this->hc1_pin != nullptr)
+                        this->hc1_pin->digital_write(!pressed);
+                  if ((chord & BTN_HC2) && this->hc2_pin != nullptr)
+                        this->hc2_pin->digital_write(!pressed);
+                  if ((chord & BTN_HC3) && this->hc3_pin != nullptr)
+                        this->hc3_pin->digital_write(!pressed);
+            }
+
+            /*
+                  Raw heights are in tenths of whatever units the controller is set to; the UNITS report tells us which.
+                  Until we've seen one, fall back to guessing from the value. From testing, desk controller seems to report these values:
+                        Height from 240..530 is in inches
+                        Height from 650..1290 is in mm
+            */
+            int32_t JarvisCB2CSensor::to_tmm_(uint16_t raw) const
+            {
+                  bool inches = this->units_ == JARVIS_UNITS_UNKNOWN ? raw < 600 : this->units_ == JARVIS_UNITS_INCH;
+                  if (inches)
+                  {
+                        // 1 inch is 25.4mm, so 1 tenth of an inch is 25.4 tenths of a mm
+                        // 407 * 25.4 = 10337.8 => 10338
+                        return ((int32_t)raw * 254 + 5) / 10;
+                  }
+                  // Tenths of a cm are mm
+                  return (int32_t)raw * 10;
+            }
+
+            /*
+                  Sequences.
+                  Each step is issued through goto_height() / goto_preset() and considered done once the desk has been seen moving
+                        and has settled again (or never moves, because it was already there). Only then does the dwell start, so
+                        slow moves stretch the schedule rather than cutting the dwell short.
+            */
+            void JarvisCB2CSensor::clear_sequence()
+            {
+                  this->cancel_sequence();
+                  this->sequence_.count = 0;
+                  this->sequence_.repeat = 1;
+            }
+
+            bool JarvisCB2CSensor::add_sequence_height(double ht_in_cm, uint16_t dwell_s)
+            {
+                  if (this->sequence_.count == SEQUENCE_MAX_STEPS)
+                  {
+                        ESP_LOGE(this->tag_, "Sequence is full (%u steps)", SEQUENCE_MAX_STEPS);
+                        return false;
+                  }
+                  SequenceStep &step = this->sequence_.steps[this->sequence_.count++];
+                  step.target_tmm = lround(ht_in_cm * 100);
+                  step.preset = 0;
+                  step.dwell_s = dwell_s;
+                  return true;
+            }
+
+            bool JarvisCB2CSensor::add_sequence_preset(int p, uint16_t dwell_s)
+            {
+                  if (p < 1 || p > 4)
+                  {
+                        ESP_LOGE(this->tag_, "Called with invalid preset number: %i", p);
+                        return false;
+                  }
+                  if (this->sequence_.count == SEQUENCE_MAX_STEPS)
+                  {
+                        ESP_LOGE(this->tag_, "Sequence is full (%u steps)", SEQUENCE_MAX_STEPS);
+                        return false;
+                  }
+                  SequenceStep &step = this->sequence_.steps[this->sequence_.count++];
+                  step.target_tmm = -1;
+                  step.preset = p;
+                  step.dwell_s = dwell_s;
+                  return true;
+            }
+
+            void JarvisCB2CSensor::start_sequence()
+            {
+                  if (this->sequence_.count == 0)
+                  {
+                        ESP_LOGW(this->tag_, "No sequence to start");
+                        return;
+                  }
+
+                  if (this->sequence_.state == SEQUENCE_PAUSED)
+                  {
+                        ESP_LOGD(this->tag_, "Resuming sequence at step %u", this->sequence_.step + 1);
+                        this->sequence_.state = SEQUENCE_RUNNING;
+                        if (this->sequence_dwelling_)
+                              this->sequence_since_ms_ = millis();
+                        else
+                              this->sequence_issue_step_();
+                  }
+                  else
+                  {
+                        ESP_LOGD(this->tag_, "Starting sequence of %u steps", this->sequence_.count);
+                        this->sequence_.state = SEQUENCE_RUNNING;
+                        this->sequence_.step = 0;
+                        this->sequence_.pass = 0;
+                        this->sequence_issue_step_();
+                  }
+                  this->sequence_pref_.save(&this->sequence_);
+            }
+
+            void JarvisCB2CSensor::pause_sequence()
+            {
+                  if (this->sequence_.state != SEQUENCE_RUNNING)
+                        return;
+
+                  ESP_LOGD(this->tag_, "Pausing sequence at step %u", this->sequence_.step + 1);
+                  if (this->sequence_dwelling_)
+                  {
+                        uint32_t dwelt = millis() - this->sequence_since_ms_;
+                        this->sequence_dwell_left_ms_ = dwelt < this->sequence_dwell_left_ms_ ? this->sequence_dwell_left_ms_ - dwelt : 0;
+                  }
+                  else
+                        this->halt_motion_();
+                  this->sequence_.state = SEQUENCE_PAUSED;
+                  this->sequence_pref_.save(&this->sequence_);
+            }
+
+            void JarvisCB2CSensor::cancel_sequence()
+            {
+                  if (this->sequence_.state == SEQUENCE_IDLE)
+                        return;
+
+                  ESP_LOGD(this->tag_, "Cancelling sequence");
+                  if (this->sequence_.state == SEQUENCE_RUNNING && !this->sequence_dwelling_)
+                        this->halt_motion_();
+                  this->sequence_.state = SEQUENCE_IDLE;
+                  this->sequence_pref_.save(&this->sequence_);
+            }
+
+            void JarvisCB2CSensor::sequence_issue_step_()
+            {
+                  const SequenceStep &step = this->sequence_.steps[this->sequence_.step];
+                  ESP_LOGD(this->tag_, "Sequence step %u of %u", this->sequence_.step + 1, this->sequence_.count);
+
+                  this->sequence_dwelling_ = false;
+                  this->sequence_saw_motion_ = false;
+                  this->sequence_since_ms_ = millis();
+                  this->sequence_dwell_left_ms_ = step.dwell_s * 1000UL;
+                  if (step.preset)
+                        this->goto_preset(step.preset);
+                  else
+                        this->goto_height(step.target_tmm * .01);
+            }
+
+            void JarvisCB2CSensor::service_sequence_(uint32_t now)
+            {
+                  if (this->sequence_.state != SEQUENCE_RUNNING)
+                        return;
+
+                  // Restored from flash; can't go anywhere until we know where we are
+                  if (this->sequence_since_ms_ == 0)
+                  {
+                        if (this->height_reported_)
+                              this->sequence_issue_step_();
+                        return;
+                  }
+
+                  if (!this->sequence_dwelling_)
                   {
-                        // 1 inch is 25.4mm, so 1 tenth of an inch is 2.54mm
-                        // 407 * 2.54 = 1033.78
-                        conv = h * 2.54;
+                        if (this->in_motion_ || this->move_state_ != MOVE_IDLE)
+                        {
+                              this->sequence_saw_motion_ = true;
+                              return;
+                        }
+                        if (!this->sequence_saw_motion_ && now - this->sequence_since_ms_ < sequence_start_timeout)
+                              return;
+
+                        // Arrived (or was already there)
+                        this->sequence_dwelling_ = true;
+                        this->sequence_since_ms_ = now;
+                        return;
                   }
-                  // Print the raw h and with the proper tenths formatting and the converted value
-                  ESP_LOGD(TAG, "Converted h(%d) => %f to %f mm", h, (h * .1), conv);
-                  return conv;
+
+                  if (now - this->sequence_since_ms_ < this->sequence_dwell_left_ms_)
+                        return;
+
+                  if (++this->sequence_.step >= this->sequence_.count)
+                  {
+                        this->sequence_.step = 0;
+                        this->sequence_.pass++;
+                        if (this->sequence_.repeat != 0 && this->sequence_.pass >= this->sequence_.repeat)
+                        {
+                              ESP_LOGD(this->tag_, "Sequence finished");
+                              this->sequence_.state = SEQUENCE_IDLE;
+                              this->sequence_pref_.save(&this->sequence_);
+                              return;
+                        }
+                  }
+                  this->sequence_pref_.save(&this->sequence_);
+                  this->sequence_issue_step_();
             }
 
-            bool JarvisCB2CSensor::verify_cb2c_checksum_(uint8_t *ptr)
+            void JarvisCB2CSensor::dump_stats()
             {
-                  _dump_packet(ptr);
-                  // byte 0,1 are address
-                  // byte 2 is the command
-                  // byte 3 is the number of parameters
-                  uint8_t param_len = ptr[3];
-                  // ESP_LOGD(TAG, "param_len: %u", param_len);
+                  uint32_t now = millis();
+                  uint32_t frames = this->parser_.frames - this->stats_frames_;
+                  float secs = (now - this->stats_since_ms_) * .001f;
 
-                  // Once we know paramater length, we know where the checksum _should_ be:
-                  // It'll be the byte right after $param_len bytes beyond the 4th byte
-                  uint8_t expected_sum_byte = (3 + (param_len + 1));
-                  // ESP_LOGD(TAG, "expected_sum_byte: %u", expected_sum_byte);
-                  // ESP_LOGD(TAG, "expected_sum: %u", ptr[expected_sum_byte]);
+                  ESP_LOGI(this->tag_, "Parsed %u frames in %.1fs (%.1f/s); %u checksum failures, %u bytes dropped in total",
+                           frames, secs, secs > 0 ? frames / secs : 0, this->parser_.checksum_failures, this->parser_.dropped_bytes);
+                  if (this->implausible_heights_)
+                        ESP_LOGI(this->tag_, "%u height reports failed the plausibility checks", this->implausible_heights_);
+                  ESP_LOGI(this->tag_, "loop(): %u calls, avg %u us, max %u us", this->loop_count_,
+                           this->loop_count_ ? this->loop_total_us_ / this->loop_count_ : 0, this->loop_max_us_);
+#ifdef USE_ESP32
+                  if (this->use_rx_task_)
+                        ESP_LOGI(this->tag_, "RX task: %u frames dropped on a full queue", this->rx_overflows_);
+#endif
 
-                  // Checksum is the 8 bit sum of all bytes after the first 2 up to the parameters.
-                  // After the first two bytes we know there will be 2 more bytes and optionally up to 3 more.
-                  // This excludes the last 2 bytes which should be checksum and EOM
-                  uint8_t calc_sum = 0;
-                  for (int i = 2; i < 4 + param_len; i++)
+                  if (this->move_stats_.moves)
                   {
-                        // ESP_LOGD(TAG, "ptr[%i]: %x", i, ptr[i]);
-                        calc_sum += ptr[i];
+                        ESP_LOGI(this->tag_, "goto_height(): %u moves, avg %u ms, avg error %.2f mm, max overshoot %.1f mm, %u reversals",
+                                 this->move_stats_.moves, this->move_stats_.total_ms / this->move_stats_.moves,
+                                 this->move_stats_.total_abs_error_tmm * .1f / this->move_stats_.moves,
+                                 this->move_stats_.max_overshoot_tmm * .1f, this->move_stats_.reversals);
                   }
-                  // ESP_LOGD(TAG, "calc_sum: %u", calc_sum);
-                  return calc_sum == ptr[expected_sum_byte];
+
+                  if (this->jog_timeouts_)
+                        ESP_LOGI(this->tag_, "Manual moves: %u stopped on a missed keepalive, worst %u ms after the last one (timeout %u ms)",
+                                 this->jog_timeouts_, this->jog_max_latency_ms_, this->jog_timeout_ms_);
+
+                  this->stats_since_ms_ = now;
+                  this->stats_frames_ = this->parser_.frames;
+                  this->loop_count_ = 0;
+                  this->loop_total_us_ = 0;
+                  this->loop_max_us_ = 0;
             }
 
-            void JarvisCB2CSensor::_dump_packet(uint8_t *ptr)
+            /*
+                  Dump the trace, oldest first, as hex. Each record is 16 bytes; see TraceRecord for the layout.
+                  Records are batched 8 to a line to keep the number of log calls down. Copy out everything between the
+                        BEGIN / END lines and strip the log prefixes to get the raw blob back.
+            */
+            void JarvisCB2CSensor::dump_trace()
             {
-                  return;
-                  // ESP_LOGD(TAG, "Got Bytes:");
-                  // for (int i = 0; i < JARVIS_PACKET_MAX_LEN; i++)
-                  // {
-                  //       ESP_LOGD(TAG, "[%i] 0x%x \t (%u)", i, ptr[i], ptr[i]);
-                  // }
+                  if (!this->trace_->enabled())
+                  {
+                        ESP_LOGW(this->tag_, "Tracing is off; set trace_size to turn it on");
+                        return;
+                  }
+
+                  static const uint8_t records_per_line = 8;
+                  uint8_t line[records_per_line * sizeof(TraceRecord)];
+                  uint16_t count = this->trace_->count();
+
+                  ESP_LOGI(this->tag_, "TRACE BEGIN %u records", count);
+                  for (uint16_t i = 0; i < count; i += records_per_line)
+                  {
+                        uint8_t n = count - i < records_per_line ? count - i : records_per_line;
+                        for (uint8_t j = 0; j < n; j++)
+                              memcpy(line + j * sizeof(TraceRecord), &this->trace_->at(i + j), sizeof(TraceRecord));
+                        ESP_LOGI(this->tag_, "%s", format_hex(line, n * sizeof(TraceRecord)).c_str());
+                  }
+                  ESP_LOGI(this->tag_, "TRACE END");
+
+                  this->trace_->clear();
             }
 
             void JarvisCB2CSensor::dump_config()
             {
-                  ESP_LOGCONFIG(TAG, "JarvisCB2CSensor desk:");
+                  ESP_LOGCONFIG(this->tag_, "JarvisCB2CSensor desk:");
                   LOG_SENSOR("", "Height", this->height_sensor_);
+                  LOG_SENSOR("", "Raw Height", this->raw_height_sensor_);
+                  LOG_SENSOR("", "Preset 1 Height", this->preset_sensors_[0]);
+                  LOG_SENSOR("", "Preset 2 Height", this->preset_sensors_[1]);
+                  LOG_SENSOR("", "Preset 3 Height", this->preset_sensors_[2]);
+                  LOG_SENSOR("", "Preset 4 Height", this->preset_sensors_[3]);
+                  LOG_SENSOR("", "Max Height", this->max_height_sensor_);
+                  LOG_SENSOR("", "Min Height", this->min_height_sensor_);
+                  LOG_TEXT_SENSOR("", "Units", this->units_text_sensor_);
+                  LOG_TEXT_SENSOR("", "Error", this->error_text_sensor_);
+                  LOG_TEXT_SENSOR("", "Memory Mode", this->memory_mode_text_sensor_);
+                  LOG_TEXT_SENSOR("", "Collision Sensitivity", this->collision_sensitivity_text_sensor_);
+                  LOG_SENSOR("", "Velocity", this->velocity_sensor_);
+                  LOG_BINARY_SENSOR("", "Moving", this->moving_binary_sensor_);
+                  LOG_TEXT_SENSOR("", "Direction", this->direction_text_sensor_);
+                  LOG_SENSOR("", "Last Move Duration", this->last_move_duration_sensor_);
+                  LOG_SENSOR("", "Last Move Distance", this->last_move_distance_sensor_);
+                  LOG_SENSOR("", "Time To Target", this->time_to_target_sensor_);
+                  LOG_SENSOR("", "Target Error", this->target_error_sensor_);
+                  ESP_LOGCONFIG(this->tag_, "  Serial commands: %s", YESNO(this->serial_commands_));
+                  if (this->on_hub_)
+                        ESP_LOGCONFIG(this->tag_, "  On a hub; polled and traced by the hub");
+                  else
+                        ESP_LOGCONFIG(this->tag_, "  Trace size: %u records", this->trace_size_);
+                  ESP_LOGCONFIG(this->tag_, "  Jog timeout: %u ms", this->jog_timeout_ms_);
+                  if (this->split_chords_)
+                        ESP_LOGCONFIG(this->tag_, "  Atomic chords: NO (%u chords take more than one write)", this->split_chords_);
+                  else
+                        ESP_LOGCONFIG(this->tag_, "  Atomic chords: YES");
+                  ESP_LOGCONFIG(this->tag_, "  Sequence: %u steps, state %u", this->sequence_.count, this->sequence_.state);
+                  ESP_LOGCONFIG(this->tag_, "  Publish hysteresis: %u tmm, min interval: %u ms", this->publish_hysteresis_tmm_,
+                                this->min_publish_interval_ms_);
+#ifdef USE_ESP32
+                  ESP_LOGCONFIG(this->tag_, "  RX task: %s", YESNO(this->use_rx_task_));
+#endif
                   LOG_PIN("hc0_pin: ", this->hc0_pin);
                   LOG_PIN("hc1_pin: ", this->hc1_pin);
                   LOG_PIN("hc2_pin: ", this->hc2_pin);
                   LOG_PIN("hc3_pin: ", this->hc3_pin);
+                  ESP_LOGCONFIG(this->tag_, "  Motion model up: decel %.1f mm/s^2, correction %.1f mm (%u moves)",
+                                this->model_.decel_tmm_s2[MOTION_UP] * .1f, this->model_.overshoot_tmm[MOTION_UP] * .1f, this->model_.samples[MOTION_UP]);
+                  ESP_LOGCONFIG(this->tag_, "  Motion model down: decel %.1f mm/s^2, correction %.1f mm (%u moves)",
+                                this->model_.decel_tmm_s2[MOTION_DOWN] * .1f, this->model_.overshoot_tmm[MOTION_DOWN] * .1f, this->model_.samples[MOTION_DOWN]);
+                  ESP_LOGCONFIG(this->tag_, "  Nudge: up %u ms moves %.1f mm, down %u ms moves %.1f mm", this->model_.nudge_ms[MOTION_UP],
+                                this->model_.nudge_tmm[MOTION_UP] * .1f, this->model_.nudge_ms[MOTION_DOWN], this->model_.nudge_tmm[MOTION_DOWN] * .1f);
             }
 
       } // namespace fully_jarvis_cb2c
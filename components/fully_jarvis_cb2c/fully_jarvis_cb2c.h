@@ -1,14 +1,163 @@
 #pragma once
 
 #include "esphome/core/component.h"
+#include "esphome/components/binary_sensor/binary_sensor.h"
 #include "esphome/components/sensor/sensor.h"
+#include "esphome/components/text_sensor/text_sensor.h"
 #include "esphome/components/uart/uart.h"
 #include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
+#include "cb2c_protocol.h"
+#include "spsc_queue.h"
+#include "trace_buffer.h"
+
+#ifdef USE_ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+#endif
+#ifdef USE_ESP8266
+#include <Arduino.h>
+#endif
 
 namespace esphome
 {
   namespace fully_jarvis_cb2c
   {
+    // Each handset line is a bit; a button "chord" is the set of lines that are pulled low together
+    static const uint8_t BTN_HC0 = 1 << 0;
+    static const uint8_t BTN_HC1 = 1 << 1;
+    static const uint8_t BTN_HC2 = 1 << 2;
+    static const uint8_t BTN_HC3 = 1 << 3;
+    static const uint8_t BTN_ALL = BTN_HC0 | BTN_HC1 | BTN_HC2 | BTN_HC3;
+
+    static const uint8_t BTN_DOWN = BTN_HC0;
+    static const uint8_t BTN_UP = BTN_HC1;
+    static const uint8_t BTN_PRESET_1 = BTN_HC0 | BTN_HC1;
+    static const uint8_t BTN_PRESET_2 = BTN_HC2;
+    static const uint8_t BTN_PRESET_3 = BTN_HC2 | BTN_HC0;
+    static const uint8_t BTN_PRESET_4 = BTN_HC2 | BTN_HC1;
+    static const uint8_t BTN_M = BTN_HC3 | BTN_HC0;
+
+    // How many button presses can be waiting to be played back
+    static const uint8_t BTN_QUEUE_LEN = 4;
+
+    // Output registers chords are written through; ESP32s with more than 32 GPIO have a second bank
+#if defined(USE_ESP32) && defined(GPIO_OUT1_W1TS_REG)
+    static const uint8_t GPIO_BANKS = 2;
+#else
+    static const uint8_t GPIO_BANKS = 1;
+#endif
+    // Bits to drive low / high, per bank, to press a chord; releasing it swaps the two. Built once in setup()
+    struct ChordMask
+    {
+      uint32_t low[GPIO_BANKS];
+      uint32_t high[GPIO_BANKS];
+    };
+
+    // Where goto_height() is in the process of getting to the target
+    enum MoveState : uint8_t
+    {
+      MOVE_IDLE = 0,
+      // Holding UP/DOWN and watching for the point to let go
+      MOVE_DRIVING,
+      // Buttons released; waiting for the desk to come to a stop so we can check how close we got
+      MOVE_SETTLING,
+    };
+
+    // Heights are carried around as integer tenths of a mm ("tmm") everywhere except the sensor publish calls.
+    //    Fine enough to represent both tenths of an inch (25.4 tmm) and mm exactly enough, and no floats per frame.
+
+    // What we've learned about how the desk coasts once UP / DOWN is let go. Persisted to flash so a reboot
+    //    doesn't throw it away. Index with MOTION_DOWN / MOTION_UP
+    static const uint8_t MOTION_DOWN = 0;
+    static const uint8_t MOTION_UP = 1;
+    struct MotionModel
+    {
+      // How hard the soft stop brakes, tmm/s^2
+      int32_t decel_tmm_s2[2];
+      // How far past the target we still end up (negative = short); we let go this much earlier
+      int32_t overshoot_tmm[2];
+      // Number of moves that went into the above
+      uint16_t samples[2];
+      // Last nudge that got the desk moving: how long the press was, ms, and how far it went, tmm (0 = press didn't
+      //    show up in the reports, try longer)
+      uint16_t nudge_ms[2];
+      int32_t nudge_tmm[2];
+    };
+
+    // One step of an on-device sequence: go somewhere, then wait there
+    static const uint8_t SEQUENCE_MAX_STEPS = 8;
+    struct SequenceStep
+    {
+      // tmm, used when preset is 0
+      int32_t target_tmm;
+      // 1-4 to recall a preset instead
+      uint8_t preset;
+      // How long to stay once the desk has stopped, seconds
+      uint16_t dwell_s;
+    };
+
+    enum SequenceState : uint8_t
+    {
+      SEQUENCE_IDLE = 0,
+      SEQUENCE_RUNNING,
+      SEQUENCE_PAUSED,
+    };
+
+    // Program and progress together so a reboot picks up where it left off. Persisted to flash
+    struct SequenceProgram
+    {
+      SequenceStep steps[SEQUENCE_MAX_STEPS];
+      uint8_t count;
+      // Times to run through the steps; 0 = until cancelled
+      uint8_t repeat;
+      uint8_t state;
+      uint8_t step;
+      uint8_t pass;
+    };
+
+    // A verified frame, stamped with when its last byte came off the wire
+    struct RxFrame
+    {
+      uint8_t data[JARVIS_PACKET_MAX_LEN];
+      uint32_t at_ms;
+    };
+    // Frames handed from the RX task to loop(); a whole second's worth of height reports
+    static const uint8_t RX_QUEUE_LEN = 32;
+
+    // Frames waiting to go out to the controller
+    static const uint8_t TX_QUEUE_LEN = 8;
+    // Nothing we send expects command 0 back; used for fire-and-forget frames
+    static const uint8_t TX_NO_ACK = 0x00;
+    // Not a command either; acknowledged by the height changing rather than by any particular frame
+    static const uint8_t TX_ACK_MOTION = 0xFF;
+    struct TxRequest
+    {
+      const TxFrame *frame;
+      // The controller command that tells us the frame was acted on
+      uint8_t ack_cmd;
+      uint8_t tries;
+    };
+
+    // Running totals describing how well goto_height() is doing
+    struct MoveStats
+    {
+      uint32_t moves;
+      uint32_t total_ms;
+      uint32_t total_abs_error_tmm;
+      int32_t max_overshoot_tmm;
+      uint32_t reversals;
+    };
+
+    // A single timed button press: hold $chord low for $duration_ms then let go
+    struct ButtonAction
+    {
+      uint8_t chord;
+      uint16_t duration_ms;
+    };
 
     class JarvisCB2CSensor : public Component, public sensor::Sensor, public uart::UARTDevice
     {
@@ -16,9 +165,43 @@ namespace esphome
       float get_setup_priority() const override { return setup_priority::LATE; }
       void setup() override;
       void loop() override;
+
+      // Tells desks on the same node apart in the logs
+      void set_log_tag(const char *tag) { this->tag_ = tag; }
+      // Hand polling and tracing over to a JarvisCB2CHub; $index is where this desk sits on it
+      void attach_to_hub(uint8_t index, TraceBuffer *trace);
+      // Everything loop() does. Called from loop() or, on a hub, from the hub's loop()
+      void poll();
+      // The part of poll() that can't wait for another desk's turn
+      void check_deadlines() { this->service_jog_(millis()); }
       void dump_config() override;
 
       void set_height_sensor(sensor::Sensor *sensor) { this->height_sensor_ = sensor; }
+      // The height exactly as the controller reports it; tenths of whatever the units are
+      void set_raw_height_sensor(sensor::Sensor *sensor) { this->raw_height_sensor_ = sensor; }
+      // Only publish once the height has moved more than $tmm from what was last published...
+      void set_publish_hysteresis(uint16_t tmm) { this->publish_hysteresis_tmm_ = tmm; }
+      // ... and no more often than every $ms. The height it settles at is always published
+      void set_min_publish_interval(uint32_t ms) { this->min_publish_interval_ms_ = ms; }
+
+      // Everything else the controller reports
+      void set_preset_height_sensor(uint8_t preset, sensor::Sensor *sensor) { this->preset_sensors_[preset - 1] = sensor; }
+      void set_max_height_sensor(sensor::Sensor *sensor) { this->max_height_sensor_ = sensor; }
+      void set_min_height_sensor(sensor::Sensor *sensor) { this->min_height_sensor_ = sensor; }
+      void set_units_text_sensor(text_sensor::TextSensor *sensor) { this->units_text_sensor_ = sensor; }
+      void set_error_text_sensor(text_sensor::TextSensor *sensor) { this->error_text_sensor_ = sensor; }
+      void set_memory_mode_text_sensor(text_sensor::TextSensor *sensor) { this->memory_mode_text_sensor_ = sensor; }
+      void set_collision_sensitivity_text_sensor(text_sensor::TextSensor *sensor) { this->collision_sensitivity_text_sensor_ = sensor; }
+
+      // Derived from the height reports as they come in
+      void set_velocity_sensor(sensor::Sensor *sensor) { this->velocity_sensor_ = sensor; }
+      void set_moving_binary_sensor(binary_sensor::BinarySensor *sensor) { this->moving_binary_sensor_ = sensor; }
+      void set_direction_text_sensor(text_sensor::TextSensor *sensor) { this->direction_text_sensor_ = sensor; }
+      void set_last_move_duration_sensor(sensor::Sensor *sensor) { this->last_move_duration_sensor_ = sensor; }
+      void set_last_move_distance_sensor(sensor::Sensor *sensor) { this->last_move_distance_sensor_ = sensor; }
+      // Only updated by goto_height()
+      void set_time_to_target_sensor(sensor::Sensor *sensor) { this->time_to_target_sensor_ = sensor; }
+      void set_target_error_sensor(sensor::Sensor *sensor) { this->target_error_sensor_ = sensor; }
 
       // GPIO we'll need to implement some functionality
       void set_hc0_pin(GPIOPin *pin) { this->hc0_pin = pin; }
@@ -26,18 +209,81 @@ namespace esphome
       void set_hc2_pin(GPIOPin *pin) { this->hc2_pin = pin; }
       void set_hc3_pin(GPIOPin *pin) { this->hc3_pin = pin; }
 
+      // Drive presets / settings by sending commands over the UART rather than pretending to push buttons
+      void set_serial_commands(bool serial_commands) { this->serial_commands_ = serial_commands; }
+
+#ifdef USE_ESP32
+      // Read the UART from a dedicated task instead of loop()
+      void set_rx_task(bool rx_task) { this->use_rx_task_ = rx_task; }
+#endif
+
       // Functions to call from lambda
       void goto_preset(int p);
       void goto_height(double h);
+      // Stop whatever the desk is doing; goto_height(), a sequence or a preset recall
+      void stop();
+      void program_preset(int p);
+      void change_units(bool inches);
 
       void do_wake();
       void do_null();
       void do_m();
 
+      /*
+            Hold-to-run. 'u' / 'd' press UP / DOWN and keep it held for as long as calls keep coming in at least every jog
+                  timeout; anything else lets go. loop() lets go on its own once the calls stop, so a client that goes
+                  away mid-jog can't leave the desk running.
+      */
       void do_manual_move(char direction);
+      void set_jog_timeout(uint32_t ms) { this->jog_timeout_ms_ = ms; }
+
+      // For the on_* automations
+      void add_on_height_reached_callback(std::function<void(float)> &&callback) { this->height_reached_callback_.add(std::move(callback)); }
+      void add_on_motion_start_callback(std::function<void()> &&callback) { this->motion_start_callback_.add(std::move(callback)); }
+      void add_on_motion_stop_callback(std::function<void(float)> &&callback) { this->motion_stop_callback_.add(std::move(callback)); }
+      void add_on_error_callback(std::function<void(std::string)> &&callback) { this->error_callback_.add(std::move(callback)); }
+
+      /*
+            On-device sequence of moves. Build it with clear / add, then start it. Each step waits for the desk to actually stop
+                  before its dwell starts, so nothing depends on the network being there once it's running.
+      */
+      void clear_sequence();
+      bool add_sequence_height(double ht_in_cm, uint16_t dwell_s);
+      bool add_sequence_preset(int p, uint16_t dwell_s);
+      void set_sequence_repeat(uint8_t times) { this->sequence_.repeat = times; }
+      void start_sequence();
+      // Stops the desk where it is; start_sequence() resumes the step / dwell that was interrupted
+      void pause_sequence();
+      void cancel_sequence();
+      bool is_sequence_running() const { return this->sequence_.state == SEQUENCE_RUNNING; }
+
+      // Log parser / loop() cost since the last call
+      void dump_stats();
+      // Frame / checksum failure / dropped byte totals since boot
+      const FrameParser &get_parser() const { return this->parser_; }
+
+      // Keep a binary trace of frames, pin changes and controller decisions; $size records of 16 bytes each
+      void set_trace_size(uint16_t size) { this->trace_size_ = size; }
+      // Log the trace as hex and start it over
+      void dump_trace();
 
     protected:
       sensor::Sensor *height_sensor_{nullptr};
+      sensor::Sensor *raw_height_sensor_{nullptr};
+      sensor::Sensor *preset_sensors_[4]{nullptr, nullptr, nullptr, nullptr};
+      sensor::Sensor *max_height_sensor_{nullptr};
+      sensor::Sensor *min_height_sensor_{nullptr};
+      text_sensor::TextSensor *units_text_sensor_{nullptr};
+      text_sensor::TextSensor *error_text_sensor_{nullptr};
+      text_sensor::TextSensor *memory_mode_text_sensor_{nullptr};
+      text_sensor::TextSensor *collision_sensitivity_text_sensor_{nullptr};
+      sensor::Sensor *velocity_sensor_{nullptr};
+      binary_sensor::BinarySensor *moving_binary_sensor_{nullptr};
+      text_sensor::TextSensor *direction_text_sensor_{nullptr};
+      sensor::Sensor *last_move_duration_sensor_{nullptr};
+      sensor::Sensor *last_move_distance_sensor_{nullptr};
+      sensor::Sensor *time_to_target_sensor_{nullptr};
+      sensor::Sensor *target_error_sensor_{nullptr};
 
       GPIOPin *hc0_pin{nullptr};
       GPIOPin *hc1_pin{nullptr};
@@ -45,18 +291,216 @@ namespace esphome
       GPIOPin *hc3_pin{nullptr};
 
       // We'll need to keep track of position for manual control
-      int16_t current_pos_{0};
-      double target_pos_{-1};
+      // Raw height as reported by the controller, in tenths of whatever units it's set to
+      uint16_t current_pos_{0};
+      // ... and converted
+      int32_t current_tmm_{0};
+      int32_t target_tmm_{-1};
 
-      bool verify_cb2c_checksum_(uint8_t *ptr);
+      int32_t to_tmm_(uint16_t raw) const;
 
-      // Util functions
-      static float _to_mm(int16_t h);
-      static void _dump_packet(uint8_t *ptr);
+      // Last settled height is saved so goto_height() has something sensible to work from right after boot
+      ESPPreferenceObject height_pref_;
+      bool height_dirty_{false};
+      // Until the controller sends us a height, we keep poking it
+      bool height_reported_{false};
+      uint8_t wake_attempts_{0};
+      uint32_t last_wake_ms_{0};
+
+      void request_height_();
+
+      // Outgoing frames. Queued, paced and re-sent until the controller acknowledges them
+      bool serial_commands_{false};
+      TxRequest tx_queue_[TX_QUEUE_LEN];
+      uint8_t tx_head_{0};
+      uint8_t tx_count_{0};
+      bool tx_in_flight_{false};
+      uint32_t tx_last_sent_ms_{0};
+
+      bool queue_frame_(const TxFrame &frame, uint8_t ack_cmd);
+      void service_tx_();
+      void tx_ack_(uint8_t cmd);
+      // Forget any MOVE / PROGMEM still queued or waiting on an ack, so a retry can't start the desk after we've stopped it
+      void drop_queued_motion_();
+
+      // What was last sent to the height sensor(s); -1 if nothing yet
+      int32_t published_tmm_{-1};
+      uint32_t published_ms_{0};
+      uint16_t publish_hysteresis_tmm_{0};
+      uint32_t min_publish_interval_ms_{0};
+      void publish_height_(bool force);
+
+      // Motion estimate, updated from every height report
+      uint32_t last_report_ms_{0};
+      uint32_t last_change_ms_{0};
+      uint32_t report_interval_ms_{0};
+      int32_t velocity_tmm_s_{0};
+      // Any movement at all, whoever started it. Begins with the first changed height report and ends once it settles
+      bool in_motion_{false};
+      int8_t motion_dir_{0};
+      uint32_t motion_started_ms_{0};
+      int32_t motion_start_tmm_{0};
+      void motion_changed_(int8_t dir);
+      void motion_ended_();
+      // Preset the controller has been asked to drive to (1-4), until the move it starts ends; 0 if none. Covers the gap
+      //    between asking and the first changed height report, when in_motion_ can't say anything's happening yet
+      uint8_t preset_pending_{0};
+      uint32_t preset_pending_since_ms_{0};
+      // stop() has already tapped a button to end the controller's move; another tap would start a new one
+      bool controller_stop_sent_{false};
+      // Preset heights as last reported, tmm; -1 until the controller tells us
+      int32_t preset_tmm_[4]{-1, -1, -1, -1};
+      // Per-direction coasting model; refined from every move we make
+      MotionModel model_;
+      ESPPreferenceObject model_pref_;
+
+      // goto_height() controller state
+      MoveState move_state_{MOVE_IDLE};
+      int8_t move_dir_{0};
+      uint32_t move_state_since_{0};
+      int32_t release_tmm_{0};
+      int32_t release_velocity_tmm_s_{0};
+      uint8_t nudges_{0};
+      // The nudge we're waiting to see the result of; 0 if the last press wasn't a nudge
+      uint16_t nudge_press_ms_{0};
+      int32_t nudge_from_tmm_{0};
+
+      // Measurements for the move in progress, and totals over every move since boot
+      uint32_t move_started_ms_{0};
+      int32_t move_start_tmm_{0};
+      int8_t move_initial_dir_{0};
+      int32_t move_peak_past_tmm_{0};
+      uint8_t move_reversals_{0};
+      MoveStats move_stats_{};
+
+      // Height reports that passed the checksum but can't be right
+      int32_t suspect_tmm_{-1};
+      uint32_t implausible_heights_{0};
+      bool height_plausible_(int32_t tmm);
 
+      void abort_motion_();
+      void finish_move_();
+
+      void update_motion_(int32_t tmm, uint32_t now);
+      bool is_stopped_(uint32_t now) const;
+      void start_drive_(int8_t dir);
+      void settle_();
+      uint16_t nudge_press_for_(int32_t delta) const;
+      void learn_from_nudge_();
+      void learn_from_move_();
+
+      FrameParser parser_;
+      // When the frame being handled arrived
+      uint32_t rx_time_ms_{0};
+      void handle_frame_(const uint8_t *frame);
+
+#ifdef USE_ESP32
+      // Optional reader task. It owns the UART RX side and parser_, and hands finished frames to loop() through rx_queue_
+      bool use_rx_task_{false};
+      TaskHandle_t rx_task_handle_{nullptr};
+      SpscQueue<RxFrame, RX_QUEUE_LEN> rx_queue_;
+      uint32_t rx_overflows_{0};
+      static void rx_task_(void *arg);
+#endif
+
+      uint16_t trace_size_{0};
+      TraceBuffer own_trace_;
+      // own_trace_, or the hub's
+      TraceBuffer *trace_{&this->own_trace_};
+      // Desk number on the hub, already shifted into place for TraceRecord::type
+      uint8_t trace_source_{0};
+
+      const char *tag_{"jarvis.2b2c"};
+      bool on_hub_{false};
+      // Preference key for this desk
+      uint32_t pref_hash_(const char *key) const;
+
+      SequenceProgram sequence_{};
+      ESPPreferenceObject sequence_pref_;
+      // Waiting for the desk to get there, or waiting out the dwell
+      bool sequence_dwelling_{false};
+      // Whether the desk has been seen moving since the step was issued
+      bool sequence_saw_motion_{false};
+      uint32_t sequence_since_ms_{0};
+      // Dwell left over from a pause
+      uint32_t sequence_dwell_left_ms_{0};
+      void sequence_issue_step_();
+      void service_sequence_(uint32_t now);
+
+      // Jogging; 0 when not
+      int8_t jog_dir_{0};
+      // Direction a jog was stopped at a limit in; ignored until released or reversed
+      int8_t jog_limit_dir_{0};
+      uint32_t jog_timeout_ms_{200};
+      uint32_t jog_keepalive_ms_{0};
+      // Worst time from the last keepalive to letting go, and how many jogs ended that way
+      uint32_t jog_max_latency_ms_{0};
+      uint16_t jog_timeouts_{0};
+      void service_jog_(uint32_t now);
+
+      CallbackManager<void(float)> height_reached_callback_;
+      CallbackManager<void()> motion_start_callback_;
+      CallbackManager<void(float)> motion_stop_callback_;
+      CallbackManager<void(std::string)> error_callback_;
+
+      // Keeps loop() running flat out while the desk is moving so stop decisions use fresh heights
+      HighFrequencyLoopRequester high_freq_;
+
+      // Frame handlers; see the dispatch tables in handle_frame_()
+      typedef void (JarvisCB2CSensor::*FrameHandler)(const uint8_t *frame);
+      void on_height_(const uint8_t *frame);
+      void on_error_(const uint8_t *frame);
+      void on_reset_(const uint8_t *frame);
+      void on_units_(const uint8_t *frame);
+      void on_memory_mode_(const uint8_t *frame);
+      void on_collision_sensitivity_(const uint8_t *frame);
+      void on_limits_(const uint8_t *frame);
+      void on_limit_height_(const uint8_t *frame);
+      void on_limit_stop_(const uint8_t *frame);
+      void on_preset_(const uint8_t *frame);
+      void on_handset_command_(const uint8_t *frame);
+
+      // Settings as last reported by the controller
+      uint8_t units_{JARVIS_UNITS_UNKNOWN};
+      uint8_t limits_{0};
+      // User limits as last reported, tmm; only enforced by us while the matching bit in limits_ is set
+      int32_t max_limit_tmm_{0};
+      int32_t min_limit_tmm_{0};
+
+      // How expensive loop() is, and how many frames it's getting through
+      uint32_t loop_count_{0};
+      uint32_t loop_total_us_{0};
+      uint32_t loop_max_us_{0};
+      uint32_t stats_since_ms_{0};
+      uint32_t stats_frames_{0};
+      uint32_t reported_checksum_failures_{0};
+
+      // Timed button presses. Presses are queued and played back from loop() so we never have to delay()
+      ButtonAction btn_queue_[BTN_QUEUE_LEN];
+      uint8_t btn_head_{0};
+      uint8_t btn_count_{0};
+      bool btn_pressed_{false};
+      uint32_t btn_release_at_{0};
+      uint32_t btn_next_at_{0};
+
+      bool queue_press_(uint8_t chord, uint16_t duration_ms);
+      void service_buttons_();
+      void write_chord_(uint8_t chord, bool pressed);
+
+      // Every chord as register masks, so all of its lines change in the same write rather than one digital_write() at a time
+      ChordMask chord_masks_[BTN_ALL + 1]{};
+      // hc pins that can't be written that way (I/O expanders, ...) and still go through digital_write()
+      uint8_t slow_pins_{0};
+      // Chords (of the configured pins) that can't be pressed in a single write
+      uint8_t split_chords_{0};
+      void build_chord_masks_();
+
+      // Util functions
       void _adjust_height();
 
       void _stop_and_release_all_buttons();
+      // The above, and end a move the controller is making on its own (preset recall) too
+      void halt_motion_();
     };
 
   } // namespace fully_jarvis_cb2c
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace esphome
+{
+  namespace fully_jarvis_cb2c
+  {
+    /*
+          Lock-free single producer / single consumer ring. push() and pop() may each be called from a different task,
+                but only ever one task per side. N must be a power of 2 no bigger than 128.
+    */
+    template<typename T, uint8_t N> class SpscQueue
+    {
+      static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0, "N must be a power of 2 <= 128");
+
+    public:
+      bool push(const T &item)
+      {
+        uint8_t tail = this->tail_.load(std::memory_order_relaxed);
+        if ((uint8_t)(tail - this->head_.load(std::memory_order_acquire)) == N)
+          return false;
+
+        this->items_[tail & (N - 1)] = item;
+        this->tail_.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+
+      bool pop(T &item)
+      {
+        uint8_t head = this->head_.load(std::memory_order_relaxed);
+        if (head == this->tail_.load(std::memory_order_acquire))
+          return false;
+
+        item = this->items_[head & (N - 1)];
+        this->head_.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+    protected:
+      T items_[N];
+      std::atomic<uint8_t> head_{0};
+      std::atomic<uint8_t> tail_{0};
+    };
+
+  } // namespace fully_jarvis_cb2c
+} // namespace esphome
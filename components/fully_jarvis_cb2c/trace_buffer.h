@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace esphome
+{
+  namespace fully_jarvis_cb2c
+  {
+    // What a TraceRecord holds
+    enum TraceType : uint8_t
+    {
+      // data: the raw frame
+      TRACE_RX_FRAME = 1,
+      TRACE_TX_FRAME = 2,
+      // data: running checksum failure count, uint32 LE
+      TRACE_CHECKSUM_FAIL = 3,
+      // data: [chord, pressed]
+      TRACE_PINS = 4,
+      // data: [TraceDecision, int32 LE value]
+      TRACE_DECISION = 5,
+    };
+
+    // On a hub the desk number (0-2) rides in the top bits of the type
+    static const uint8_t TRACE_SOURCE_SHIFT = 6;
+    static const uint8_t TRACE_TYPE_MASK = (1 << TRACE_SOURCE_SHIFT) - 1;
+
+    enum TraceDecision : uint8_t
+    {
+      // value: height (tmm) we let go at
+      DECISION_RELEASE = 1,
+      // value: error (tmm) at the end of the move
+      DECISION_DONE = 2,
+      // value: error (tmm) we're tapping to fix
+      DECISION_NUDGE = 3,
+      // value: target (tmm) that was abandoned, or -1
+      DECISION_STOP = 4,
+      // value: target (tmm)
+      DECISION_START = 5,
+    };
+
+    /*
+          One 16 byte record; dumped as-is (little endian) so the dump can be decoded / replayed elsewhere:
+                [0..3] timestamp, us   [4] TraceType | desk << 6   [5] number of valid data bytes   [6..15] data
+    */
+    struct TraceRecord
+    {
+      uint32_t t_us;
+      uint8_t type;
+      uint8_t len;
+      uint8_t data[10];
+    };
+    static_assert(sizeof(TraceRecord) == 16, "TraceRecord should pack into 16 bytes");
+
+    /*
+          Fixed size ring of TraceRecords. Storage is allocated once by init(); until then (or if tracing is off)
+                record() is a single compare. Oldest records are overwritten once full.
+    */
+    class TraceBuffer
+    {
+    public:
+      TraceBuffer() = default;
+      // Owns its storage; on the device it lives as long as the component, on the host desks come and go
+      TraceBuffer(const TraceBuffer &) = delete;
+      TraceBuffer &operator=(const TraceBuffer &) = delete;
+      ~TraceBuffer() { delete[] this->records_; }
+
+      void init(uint16_t size)
+      {
+        this->records_ = new TraceRecord[size];
+        this->size_ = size;
+      }
+
+      bool enabled() const { return this->size_ != 0; }
+
+      void record(uint32_t t_us, uint8_t type, const uint8_t *data, uint8_t len)
+      {
+        if (this->size_ == 0)
+          return;
+
+        if (len > sizeof(TraceRecord::data))
+          len = sizeof(TraceRecord::data);
+
+        TraceRecord &r = this->records_[this->next_];
+        r.t_us = t_us;
+        r.type = type;
+        r.len = len;
+        memcpy(r.data, data, len);
+        memset(r.data + len, 0, sizeof(r.data) - len);
+
+        this->next_ = this->next_ + 1 == this->size_ ? 0 : this->next_ + 1;
+        if (this->count_ < this->size_)
+          this->count_++;
+      }
+
+      void record_decision(uint32_t t_us, uint8_t decision, int32_t value, uint8_t source = 0)
+      {
+        uint8_t data[5] = {decision, (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+        this->record(t_us, TRACE_DECISION | source, data, sizeof(data));
+      }
+
+      uint16_t count() const { return this->count_; }
+
+      // i = 0 is the oldest record still held
+      const TraceRecord &at(uint16_t i) const
+      {
+        uint16_t start = this->count_ < this->size_ ? 0 : this->next_;
+        return this->records_[(start + i) % this->size_];
+      }
+
+      void clear()
+      {
+        this->next_ = 0;
+        this->count_ = 0;
+      }
+
+    protected:
+      TraceRecord *records_{nullptr};
+      uint16_t size_{0};
+      uint16_t next_{0};
+      uint16_t count_{0};
+    };
+
+  } // namespace fully_jarvis_cb2c
+} // namespace esphome
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "host/host_desk.h"
+
+/*
+      Frames per second through the decoder, so a hardening change can be checked for what it costs. Two numbers:
+            FrameParser on its own, over a buffer of controller traffic, and the same traffic through loop() and the frame
+            handlers. The traffic is height reports for a desk going up and down with the odd settings frame, and optionally
+            a percentage of noise bytes. Build with -DCB2C_SANITIZE=OFF for numbers worth comparing.
+
+      usage: cb2c_bench_parser [frames] [noise percent]
+*/
+using namespace esphome;
+using namespace esphome::fully_jarvis_cb2c;
+
+static double seconds_since(std::chrono::steady_clock::time_point started)
+{
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+int main(int argc, char **argv)
+{
+      uint32_t frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+      uint32_t noise_percent = argc > 2 ? strtoul(argv[2], nullptr, 10) : 0;
+
+      std::mt19937 rng(1);
+      std::vector<uint8_t> stream;
+      std::vector<size_t> frame_ends;
+      uint8_t frame[JARVIS_PACKET_MAX_LEN];
+      // mm, moving 2mm a report between the ends of travel
+      int32_t height = 720;
+      int8_t dir = 1;
+      for (uint32_t i = 0; i < frames; i++)
+      {
+            if (rng() % 100 < noise_percent)
+                  stream.push_back(rng());
+
+            uint8_t len;
+            if (i % 50 == 49)
+            {
+                  const uint8_t params[] = {0x02, 0xD0};
+                  len = host::make_controller_frame(frame, JARVIS_CMD_PRESET_1 + (i / 50) % 4, params, sizeof(params));
+            }
+            else
+            {
+                  height += 2 * dir;
+                  if (height >= 1270 || height <= 620)
+                        dir = -dir;
+                  const uint8_t params[] = {(uint8_t)(height >> 8), (uint8_t)height, 0x00};
+                  len = host::make_controller_frame(frame, JARVIS_CMD_HEIGHT, params, sizeof(params));
+            }
+            stream.insert(stream.end(), frame, frame + len);
+            frame_ends.push_back(stream.size());
+      }
+
+      FrameParser parser;
+      auto started = std::chrono::steady_clock::now();
+      for (uint8_t b : stream)
+      {
+            parser.push(b);
+            while (parser.read_frame(frame))
+                  ;
+      }
+      double secs = seconds_since(started);
+      printf("FrameParser: %u frames (%zu bytes, %u%% noise) in %.3f s: %.0f frames/s, %.1f ns/byte; %u checksum failures\n",
+             parser.frames, stream.size(), noise_percent, secs, parser.frames / secs, secs * 1e9 / stream.size(), parser.checksum_failures);
+
+      // Through the component: one frame's worth of bytes per loop(), as though loop() kept up with the wire
+      host::HostDesk bench;
+      bench.setup();
+      bench.run_for(100);
+      size_t from = 0;
+      uint32_t desk_frames = frames / 10;
+      for (uint32_t i = 0; i < desk_frames; i++)
+      {
+            bench.uart.inject(&stream[from], frame_ends[i] - from);
+            from = frame_ends[i];
+            bench.run_for(1);
+      }
+      const FrameParser &desk_parser = bench.desk.get_parser();
+      const host::LoopStats &loops = bench.loop_stats;
+      printf("loop(): %u frames in %u calls, %.0f frames/s of loop() time, avg %.2f us, max %.2f us per call\n", desk_parser.frames,
+             loops.calls, desk_parser.frames / (loops.total_ns * 1e-9), loops.total_ns * 1e-3 / loops.calls, loops.max_ns * 1e-3);
+      return 0;
+}
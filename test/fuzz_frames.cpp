@@ -0,0 +1,50 @@
+#include <stdlib.h>
+
+#include "host/host_desk.h"
+
+/*
+      libFuzzer entry point for the frame decoding path: the parser on its own, verify_checksum() on whatever it's given and
+            the component's frame handlers behind it. Anything read_frame() hands out that isn't a whole checksummed frame
+            aborts; out of bounds accesses are left to the sanitizers.
+      Built as cb2c_fuzz_frames with clang (-fsanitize=fuzzer); everywhere else fuzz_main.cpp drives it with random input.
+*/
+using namespace esphome;
+using namespace esphome::fully_jarvis_cb2c;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+      FrameParser parser;
+      uint8_t frame[JARVIS_PACKET_MAX_LEN];
+      for (size_t i = 0; i < size; i++)
+      {
+            parser.push(data[i]);
+            while (uint8_t len = parser.read_frame(frame))
+            {
+                  if (len < JARVIS_FRAME_OVERHEAD || len > JARVIS_PACKET_MAX_LEN || frame[1] != frame[0] ||
+                      frame[3] + JARVIS_FRAME_OVERHEAD != len || frame[len - 1] != JARVIS_EOM || !verify_checksum(frame, len))
+                        abort();
+            }
+      }
+
+      // Exactly as many bytes as it's told it has
+      if (size > 0)
+      {
+            uint8_t len = size < JARVIS_PACKET_MAX_LEN ? size : JARVIS_PACKET_MAX_LEN;
+            uint8_t *copy = new uint8_t[len];
+            for (uint8_t i = 0; i < len; i++)
+                  copy[i] = data[i];
+            verify_checksum(copy, len);
+            delete[] copy;
+      }
+
+      // One desk for the whole run, like the real thing; it's seen every input before this one
+      static host::HostDesk *bench = nullptr;
+      if (bench == nullptr)
+      {
+            bench = new host::HostDesk();
+            bench->setup();
+      }
+      bench->send(data, size);
+      bench->run_for(20);
+      return 0;
+}
@@ -0,0 +1,48 @@
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+/*
+      Stands in for libFuzzer where there isn't one. Runs LLVMFuzzerTestOneInput() over each file named on the command line
+            (a crash reproducer, say), or over a number of random inputs: cb2c_fuzz_frames_random [files... | iterations [seed]]
+*/
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char **argv)
+{
+      char *end;
+      unsigned long iterations = argc > 1 ? strtoul(argv[1], &end, 10) : 10000;
+      if (argc > 1 && *end != '\0')
+      {
+            for (int i = 1; i < argc; i++)
+            {
+                  std::ifstream in(argv[i], std::ios::binary);
+                  if (!in)
+                  {
+                        fprintf(stderr, "%s: can't open\n", argv[i]);
+                        return 2;
+                  }
+                  std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                  LLVMFuzzerTestOneInput(data.data(), data.size());
+            }
+            printf("Ran %d inputs\n", argc - 1);
+            return 0;
+      }
+
+      std::mt19937 rng(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1);
+      std::vector<uint8_t> data;
+      for (unsigned long i = 0; i < iterations; i++)
+      {
+            // Frame sized or a little over, mostly made of bytes the parser cares about
+            static const uint8_t interesting[] = {0xF2, 0xF1, 0x7E, 0x00, 0x01, 0x02, 0x03, 0x04};
+            data.resize(rng() % 40);
+            for (uint8_t &b : data)
+                  b = rng() % 2 ? interesting[rng() % sizeof(interesting)] : rng();
+            LLVMFuzzerTestOneInput(data.data(), data.size());
+      }
+      printf("Ran %lu random inputs\n", iterations);
+      return 0;
+}
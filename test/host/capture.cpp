@@ -0,0 +1,170 @@
+#include <fstream>
+#include <sstream>
+
+#include "capture.h"
+#include "trace_buffer.h"
+
+namespace esphome
+{
+      namespace host
+      {
+            static int hex_digit(char c)
+            {
+                  if (c >= '0' && c <= '9')
+                        return c - '0';
+                  if (c >= 'a' && c <= 'f')
+                        return c - 'a' + 10;
+                  if (c >= 'A' && c <= 'F')
+                        return c - 'A' + 10;
+                  return -1;
+            }
+
+            bool load_capture(const std::string &path, std::vector<CaptureEvent> &events, std::string &error)
+            {
+                  std::ifstream in(path);
+                  if (!in)
+                  {
+                        error = path + ": can't open";
+                        return false;
+                  }
+
+                  std::string line;
+                  uint32_t line_no = 0;
+                  uint32_t last_ms = 0;
+                  while (std::getline(in, line))
+                  {
+                        line_no++;
+                        std::string where = path + ":" + std::to_string(line_no) + ": ";
+                        line = line.substr(0, line.find('#'));
+
+                        std::istringstream fields(line);
+                        std::string token;
+                        if (!(fields >> token))
+                              continue;
+
+                        CaptureEvent event{};
+                        char *end;
+                        unsigned long ms = strtoul(token.c_str(), &end, 10);
+                        if (*end != '\0')
+                        {
+                              error = where + "expected a time in ms, got '" + token + "'";
+                              return false;
+                        }
+                        if (ms < last_ms)
+                        {
+                              error = where + "time goes backwards";
+                              return false;
+                        }
+                        event.at_ms = last_ms = ms;
+
+                        if (!(fields >> token))
+                              continue;
+                        if (token[0] == '!')
+                        {
+                              event.call = token.substr(1);
+                              fields >> event.arg;
+                              events.push_back(event);
+                              continue;
+                        }
+
+                        do
+                        {
+                              if (token.size() % 2 != 0)
+                              {
+                                    error = where + "odd number of hex digits in '" + token + "'";
+                                    return false;
+                              }
+                              for (size_t i = 0; i < token.size(); i += 2)
+                              {
+                                    int hi = hex_digit(token[i]);
+                                    int lo = hex_digit(token[i + 1]);
+                                    if (hi < 0 || lo < 0)
+                                    {
+                                          error = where + "bad hex byte in '" + token + "'";
+                                          return false;
+                                    }
+                                    event.bytes.push_back(hi << 4 | lo);
+                              }
+                        } while (fields >> token);
+                        events.push_back(event);
+                  }
+                  return true;
+            }
+
+            bool load_trace(const std::string &path, std::vector<CaptureEvent> &events, std::string &error, int desk)
+            {
+                  using fully_jarvis_cb2c::TraceRecord;
+
+                  std::ifstream in(path);
+                  if (!in)
+                  {
+                        error = path + ": can't open";
+                        return false;
+                  }
+
+                  std::string line;
+                  uint32_t line_no = 0;
+                  bool in_dump = false;
+                  bool seen_dump = false;
+                  bool have_first = false;
+                  uint32_t first_us = 0;
+                  while (std::getline(in, line))
+                  {
+                        line_no++;
+                        std::string where = path + ":" + std::to_string(line_no) + ": ";
+                        if (line.find("TRACE BEGIN") != std::string::npos)
+                        {
+                              in_dump = seen_dump = true;
+                              continue;
+                        }
+                        if (line.find("TRACE END") != std::string::npos)
+                        {
+                              in_dump = false;
+                              continue;
+                        }
+                        if (!in_dump)
+                              continue;
+
+                        // The message is whatever follows the logger's "[I][tag:line]: ", up to any colour reset
+                        size_t at = line.rfind("]: ");
+                        at = at == std::string::npos ? 0 : at + 3;
+                        std::vector<uint8_t> bytes;
+                        for (; at + 1 < line.size() && hex_digit(line[at]) >= 0 && hex_digit(line[at + 1]) >= 0; at += 2)
+                              bytes.push_back(hex_digit(line[at]) << 4 | hex_digit(line[at + 1]));
+                        if (bytes.empty() || bytes.size() % sizeof(TraceRecord) != 0)
+                        {
+                              error = where + "expected whole 16 byte trace records";
+                              return false;
+                        }
+
+                        for (size_t i = 0; i < bytes.size(); i += sizeof(TraceRecord))
+                        {
+                              const uint8_t *r = &bytes[i];
+                              uint32_t t_us = r[0] | r[1] << 8 | r[2] << 16 | (uint32_t)r[3] << 24;
+                              uint8_t type = r[4] & fully_jarvis_cb2c::TRACE_TYPE_MASK;
+                              uint8_t source = r[4] >> fully_jarvis_cb2c::TRACE_SOURCE_SHIFT;
+                              uint8_t len = r[5] < sizeof(TraceRecord::data) ? r[5] : sizeof(TraceRecord::data);
+                              if (!have_first)
+                              {
+                                    first_us = t_us;
+                                    have_first = true;
+                              }
+                              if (type != fully_jarvis_cb2c::TRACE_RX_FRAME || (desk >= 0 && source != desk))
+                                    continue;
+
+                              // micros() wraps every ~71 minutes; the difference doesn't care
+                              CaptureEvent event{};
+                              event.at_ms = trace_lead_in_ms + (t_us - first_us) / 1000;
+                              event.bytes.assign(r + 6, r + 6 + len);
+                              events.push_back(event);
+                        }
+                  }
+                  if (!seen_dump)
+                  {
+                        error = path + ": no TRACE BEGIN in it";
+                        return false;
+                  }
+                  return true;
+            }
+      } // namespace host
+} // namespace esphome
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+      Recorded UART captures, as text so they can be read and edited by hand. One event per line:
+
+            <ms> <hex bytes>          bytes the controller sent, e.g. "120 f2 f2 01 03 02 d0 00 d6 7e" or "120 f2f2010302d000d67e"
+            <ms> !<call> [arg]        something done to the desk at that point: goto_height <cm>, goto_preset <n>, stop,
+                                            jog <u|d|s>, dump_stats
+
+      <ms> is from boot and never goes backwards. Anything after a '#' is a comment.
+
+      load_trace() reads a device log with dump_trace() output in it instead (as it comes off the ESPHome logger, prefixes,
+            colours and all) and makes an event of every frame the desk received. Times are from the first record, plus
+            trace_lead_in_ms so the frames don't land before setup() has run.
+*/
+namespace esphome
+{
+  namespace host
+  {
+    struct CaptureEvent
+    {
+      uint32_t at_ms;
+      std::vector<uint8_t> bytes;
+      // Empty for bytes
+      std::string call;
+      std::string arg;
+    };
+
+    // False, with $error saying where and why, if the file can't be read or doesn't parse
+    bool load_capture(const std::string &path, std::vector<CaptureEvent> &events, std::string &error);
+
+    static const uint32_t trace_lead_in_ms = 100;
+    // Only the frames desk $desk (on a hub) received, if it's 0-2
+    bool load_trace(const std::string &path, std::vector<CaptureEvent> &events, std::string &error, int desk = -1);
+  } // namespace host
+} // namespace esphome
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdio.h>
+
+/*
+      Just enough of a test framework for the host tests: CHECK() notes the failure and carries on, RUN_TEST() runs a test
+            on a fresh clock / preference store. main() returns check_failures != 0.
+*/
+namespace esphome
+{
+  namespace host
+  {
+    extern int check_failures;
+  } // namespace host
+} // namespace esphome
+
+#define CHECK(cond) \
+  do \
+  { \
+    if (!(cond)) \
+    { \
+      printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      ::esphome::host::check_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do \
+  { \
+    long long a_ = (a), b_ = (b); \
+    if (a_ != b_) \
+    { \
+      printf("  %s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+      ::esphome::host::check_failures++; \
+    } \
+  } while (0)
+
+#define RUN_TEST(fn) \
+  do \
+  { \
+    ::esphome::host::reset(); \
+    int before_ = ::esphome::host::check_failures; \
+    fn(); \
+    printf("%s %s\n", ::esphome::host::check_failures == before_ ? "PASS" : "FAIL", #fn); \
+  } while (0)
@@ -0,0 +1,198 @@
+#include <math.h>
+
+#include "desk_sim.h"
+
+namespace esphome
+{
+      namespace host
+      {
+            using namespace fully_jarvis_cb2c;
+
+            // Physics runs in 1ms steps whatever the loop() cadence
+            static const uint64_t SIM_STEP_US = 1000;
+
+            DeskSim::DeskSim(HostDesk &bench, uint8_t units, int32_t start_tmm, const DeskPhysics &physics)
+                : bench_(bench), physics_(physics), units_(units), pos_tmm_(start_tmm)
+            {
+                  this->now_us_ = now_us();
+                  this->reset_stats();
+
+                  for (uint8_t i = 0; i < 4; i++)
+                  {
+                        this->bench_.pins[i].on_write = [this, i](bool level) {
+                              if (level)
+                                    this->held_ &= ~(1 << i);
+                              else
+                                    this->held_ |= 1 << i;
+                              this->chord_changes_.push_back({now_us() + this->physics_.button_latency_ms * 1000, this->held_});
+                        };
+                  }
+                  this->bench_.uart.on_tx = [this](const uint8_t *data, size_t len) { this->on_tx_(data, len); };
+                  this->bench_.before_loop = [this](uint64_t now) { this->step(now); };
+            }
+
+            void DeskSim::reset_stats()
+            {
+                  this->reversals_ = 0;
+                  this->last_dir_ = 0;
+                  this->last_moving_us_ = this->now_us_;
+                  this->highest_tmm_ = this->pos_tmm_;
+                  this->lowest_tmm_ = this->pos_tmm_;
+            }
+
+            void DeskSim::step(uint64_t now_us)
+            {
+                  while (this->now_us_ + SIM_STEP_US <= now_us)
+                  {
+                        this->now_us_ += SIM_STEP_US;
+                        this->tick_(this->now_us_, SIM_STEP_US * 1e-6);
+                  }
+
+                  while (!this->outgoing_.empty() && this->outgoing_.front().at_us <= now_us)
+                  {
+                        const std::vector<uint8_t> &bytes = this->outgoing_.front().bytes;
+                        this->bench_.uart.inject(bytes.data(), bytes.size());
+                        this->outgoing_.pop_front();
+                  }
+            }
+
+            void DeskSim::tick_(uint64_t now_us, double dt)
+            {
+                  while (!this->chord_changes_.empty() && this->chord_changes_.front().at_us <= now_us)
+                  {
+                        this->seen_ = this->chord_changes_.front().chord;
+                        this->chord_changes_.pop_front();
+                        // Any button stops a preset recall
+                        if (this->seen_ != 0)
+                              this->driving_preset_ = 0;
+                  }
+
+                  int8_t drive = this->seen_ == BTN_UP ? 1 : this->seen_ == BTN_DOWN ? -1 : 0;
+                  if (this->driving_preset_)
+                  {
+                        // The controller brakes itself so it stops right on the preset
+                        double remaining = this->presets_tmm_[this->driving_preset_ - 1] - this->pos_tmm_;
+                        uint8_t d = remaining > 0 ? MOTION_UP : MOTION_DOWN;
+                        double coast = this->v_tmm_s_ * this->v_tmm_s_ / (2 * this->physics_.decel_tmm_s2[d]);
+                        if (fabs(remaining) <= coast + 1)
+                              this->driving_preset_ = 0;
+                        else
+                              drive = remaining > 0 ? 1 : -1;
+                  }
+
+                  double v = this->v_tmm_s_;
+                  if (drive != 0 && (v == 0 || (v > 0) == (drive > 0)))
+                  {
+                        // Soft start up to cruise
+                        double cruise = this->physics_.cruise_tmm_s[drive > 0 ? MOTION_UP : MOTION_DOWN];
+                        v += drive * this->physics_.accel_tmm_s2 * dt;
+                        if (fabs(v) > cruise)
+                              v = drive * cruise;
+                  }
+                  else if (v != 0)
+                  {
+                        // Soft stop; a reversal has to come to a stop first
+                        double decel = this->physics_.decel_tmm_s2[v > 0 ? MOTION_UP : MOTION_DOWN] * dt;
+                        v = fabs(v) <= decel ? 0 : v - (v > 0 ? decel : -decel);
+                  }
+
+                  this->pos_tmm_ += v * dt;
+                  if (this->pos_tmm_ >= this->physics_.max_tmm || this->pos_tmm_ <= this->physics_.min_tmm)
+                  {
+                        this->pos_tmm_ = this->pos_tmm_ >= this->physics_.max_tmm ? this->physics_.max_tmm : this->physics_.min_tmm;
+                        v = 0;
+                        this->driving_preset_ = 0;
+                  }
+                  this->v_tmm_s_ = v;
+
+                  if (v != 0)
+                  {
+                        int8_t dir = v > 0 ? 1 : -1;
+                        if (this->last_dir_ != 0 && dir != this->last_dir_)
+                              this->reversals_++;
+                        this->last_dir_ = dir;
+                        this->last_moving_us_ = now_us;
+                        if (this->pos_tmm_ > this->highest_tmm_)
+                              this->highest_tmm_ = this->pos_tmm_;
+                        if (this->pos_tmm_ < this->lowest_tmm_)
+                              this->lowest_tmm_ = this->pos_tmm_;
+                  }
+
+                  // Reports while moving, and for a little while after so the handset shows where it stopped
+                  bool reporting = now_us - this->last_moving_us_ <= this->physics_.idle_reports_ms * 1000ULL;
+                  if (reporting && now_us - this->last_report_us_ >= this->physics_.report_interval_ms * 1000ULL)
+                        this->send_height_();
+            }
+
+            uint16_t DeskSim::to_raw_(double tmm) const
+            {
+                  // Tenths of an inch, or mm
+                  if (this->units_ == JARVIS_UNITS_INCH)
+                        return lround(tmm / 25.4);
+                  return lround(tmm / 10);
+            }
+
+            void DeskSim::send_height_()
+            {
+                  uint16_t raw = this->to_raw_(this->pos_tmm_);
+                  this->send_(JARVIS_CMD_HEIGHT, {(uint8_t)(raw >> 8), (uint8_t)raw, 0x00});
+                  this->last_report_us_ = this->now_us_;
+            }
+
+            void DeskSim::send_(uint8_t cmd, std::initializer_list<uint8_t> params)
+            {
+                  uint8_t frame[JARVIS_PACKET_MAX_LEN];
+                  uint8_t len = make_controller_frame(frame, cmd, params.begin(), params.size());
+
+                  // Frames queue up behind each other on the wire and turn up once their last byte is in
+                  uint64_t start = this->line_free_us_ > this->now_us_ ? this->line_free_us_ : this->now_us_;
+                  this->line_free_us_ = start + len * this->physics_.byte_time_us;
+                  this->outgoing_.push_back({this->line_free_us_, std::vector<uint8_t>(frame, frame + len)});
+            }
+
+            void DeskSim::on_tx_(const uint8_t *data, size_t len)
+            {
+                  uint8_t frame[JARVIS_PACKET_MAX_LEN];
+                  for (size_t i = 0; i < len; i++)
+                  {
+                        this->parser_.push(data[i]);
+                        while (this->parser_.read_frame(frame))
+                        {
+                              if (frame[0] != JARVIS_ADDR_HANDSET)
+                                    continue;
+                              if (this->drop_frames_ != 0)
+                              {
+                                    this->drop_frames_--;
+                                    continue;
+                              }
+                              switch (frame[2])
+                              {
+                              case JARVIS_CMD_WAKE:
+                                    this->send_height_();
+                                    break;
+                              case JARVIS_CMD_SETTINGS:
+                                    this->send_(JARVIS_CMD_UNITS, {this->units_});
+                                    for (uint8_t p = 0; p < 4; p++)
+                                    {
+                                          uint16_t raw = this->to_raw_(this->presets_tmm_[p]);
+                                          this->send_(JARVIS_CMD_PRESET_1 + p, {(uint8_t)(raw >> 8), (uint8_t)raw});
+                                    }
+                                    break;
+                              case JARVIS_CMD_MOVE_1:
+                                    this->driving_preset_ = 1;
+                                    break;
+                              case JARVIS_CMD_MOVE_2:
+                                    this->driving_preset_ = 2;
+                                    break;
+                              case JARVIS_CMD_MOVE_3:
+                                    this->driving_preset_ = 3;
+                                    break;
+                              case JARVIS_CMD_MOVE_4:
+                                    this->driving_preset_ = 4;
+                                    break;
+                              }
+                        }
+                  }
+            }
+      } // namespace host
+} // namespace esphome
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+#include "host_desk.h"
+
+namespace esphome
+{
+  namespace host
+  {
+    // How the simulated desk moves. Index per direction with MOTION_DOWN / MOTION_UP
+    struct DeskPhysics
+    {
+      // Cruise speed once the soft start is over
+      int32_t cruise_tmm_s[2]{400, 380};
+      // Soft start
+      int32_t accel_tmm_s2{1000};
+      // Soft stop, once the button is let go; a little firmer going up
+      int32_t decel_tmm_s2[2]{1300, 1600};
+      // How long the controller takes to notice a button change
+      uint32_t button_latency_ms{20};
+      // Height reports while moving, and for a while after it stops
+      uint32_t report_interval_ms{50};
+      uint32_t idle_reports_ms{1000};
+      // Frames take ~1ms a byte at 9600 baud to come over the wire
+      uint32_t byte_time_us{1042};
+      // The 3 stage frame; 62-127cm
+      int32_t min_tmm{6200};
+      int32_t max_tmm{12700};
+    };
+
+    /*
+          A CB2C controller and the legs it drives, wired to a HostDesk: it watches the hc lines, moves with a soft start /
+                stop, stops at the frame's limits and sends height reports the way the real one does, in inches or mm. WAKE
+                gets a height report, SETTINGS the units and presets, and MOVE_n drives to preset n.
+          Keeps the ground truth (where the desk really is, every reversal) so a benchmark can score a move on more than
+                what the quantized reports show.
+    */
+    class DeskSim
+    {
+    public:
+      DeskSim(HostDesk &bench, uint8_t units, int32_t start_tmm, const DeskPhysics &physics = DeskPhysics{});
+
+      // Bring the desk up to $now_us and deliver anything it has sent by then. HostDesk::before_loop calls this
+      void step(uint64_t now_us);
+
+      double height_tmm() const { return this->pos_tmm_; }
+      bool is_moving() const { return this->v_tmm_s_ != 0; }
+      void set_preset(uint8_t preset, int32_t tmm) { this->presets_tmm_[preset - 1] = tmm; }
+      // Lose the next $n frames from the handset, as if they'd been garbled on the wire
+      void drop_next_frames(uint32_t n) { this->drop_frames_ = n; }
+
+      // Ground truth since the last reset_stats()
+      void reset_stats();
+      uint32_t reversals() const { return this->reversals_; }
+      uint64_t last_moving_us() const { return this->last_moving_us_; }
+      double highest_tmm() const { return this->highest_tmm_; }
+      double lowest_tmm() const { return this->lowest_tmm_; }
+
+    protected:
+      void tick_(uint64_t now_us, double dt);
+      void on_tx_(const uint8_t *data, size_t len);
+      void send_(uint8_t cmd, std::initializer_list<uint8_t> params);
+      void send_height_();
+      uint16_t to_raw_(double tmm) const;
+
+      HostDesk &bench_;
+      DeskPhysics physics_;
+      uint8_t units_;
+      int32_t presets_tmm_[4]{7200, 7600, 10000, 11000};
+
+      double pos_tmm_;
+      double v_tmm_s_{0};
+      uint64_t now_us_{0};
+      uint64_t last_report_us_{0};
+      uint64_t last_moving_us_{0};
+
+      // hc lines currently held low, and the same as the controller sees them once button_latency_ms has gone by
+      uint8_t held_{0};
+      uint8_t seen_{0};
+      struct ChordChange
+      {
+        uint64_t at_us;
+        uint8_t chord;
+      };
+      std::deque<ChordChange> chord_changes_;
+      // Preset the controller is driving to on its own, 0 if none
+      uint8_t driving_preset_{0};
+
+      fully_jarvis_cb2c::FrameParser parser_;
+      uint32_t drop_frames_{0};
+      struct Outgoing
+      {
+        uint64_t at_us;
+        std::vector<uint8_t> bytes;
+      };
+      std::deque<Outgoing> outgoing_;
+      // The wire is busy until then
+      uint64_t line_free_us_{0};
+
+      int8_t last_dir_{0};
+      uint32_t reversals_{0};
+      double highest_tmm_;
+      double lowest_tmm_;
+    };
+  } // namespace host
+} // namespace esphome
@@ -0,0 +1,142 @@
+#include <map>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host.h"
+#include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+
+namespace esphome
+{
+      namespace setup_priority
+      {
+            const float BUS = 1000.0f;
+            const float DATA = 600.0f;
+            const float LATE = -100.0f;
+      } // namespace setup_priority
+
+      int host_log_level = ESPHOME_LOG_LEVEL_NONE;
+      FILE *host_log_file = nullptr;
+
+      void host_log(int level, const char *tag, const char *format, ...)
+      {
+            if (level > host_log_level)
+                  return;
+            static const char LEVELS[] = "?EWICDVV";
+            FILE *out = host_log_file != nullptr ? host_log_file : stderr;
+            fprintf(out, "[%10.3f][%c][%s]: ", host::now_us() / 1000.0, LEVELS[level], tag);
+            va_list args;
+            va_start(args, format);
+            vfprintf(out, format, args);
+            va_end(args);
+            fputc('\n', out);
+      }
+
+      uint32_t fnv1_hash(const std::string &str)
+      {
+            uint32_t hash = 2166136261UL;
+            for (char c : str)
+            {
+                  hash *= 16777619UL;
+                  hash ^= c;
+            }
+            return hash;
+      }
+
+      std::string format_hex(const uint8_t *data, size_t length)
+      {
+            static const char DIGITS[] = "0123456789abcdef";
+            std::string ret;
+            ret.reserve(length * 2);
+            for (size_t i = 0; i < length; i++)
+            {
+                  ret += DIGITS[data[i] >> 4];
+                  ret += DIGITS[data[i] & 0x0F];
+            }
+            return ret;
+      }
+
+      static uint64_t clock_us = 0;
+
+      uint32_t millis() { return clock_us / 1000; }
+      uint32_t micros() { return clock_us; }
+      void delay(uint32_t ms) { clock_us += (uint64_t)ms * 1000; }
+      void delayMicroseconds(uint32_t us) { clock_us += us; }
+
+      static int high_frequency_requests = 0;
+
+      void HighFrequencyLoopRequester::start()
+      {
+            if (this->started_)
+                  return;
+            high_frequency_requests++;
+            this->started_ = true;
+      }
+
+      void HighFrequencyLoopRequester::stop()
+      {
+            if (!this->started_)
+                  return;
+            high_frequency_requests--;
+            this->started_ = false;
+      }
+
+      bool HighFrequencyLoopRequester::is_high_frequency() { return high_frequency_requests > 0; }
+
+      // Keyed the same way as on the device, so two desks that would collide in flash collide here too
+      static std::map<uint32_t, std::vector<uint8_t>> preference_store;
+      static ESPPreferences host_preferences;
+      ESPPreferences *global_preferences = &host_preferences;
+
+      bool ESPPreferenceObject::save_(const void *src, size_t size)
+      {
+            if (size != this->size_)
+                  return false;
+            const uint8_t *bytes = static_cast<const uint8_t *>(src);
+            preference_store[this->key_].assign(bytes, bytes + size);
+            return true;
+      }
+
+      bool ESPPreferenceObject::load_(void *dest, size_t size)
+      {
+            auto it = preference_store.find(this->key_);
+            if (it == preference_store.end() || it->second.size() != size)
+                  return false;
+            memcpy(dest, it->second.data(), size);
+            return true;
+      }
+
+      namespace host
+      {
+            std::vector<PinEdge> pin_edges;
+            int check_failures = 0;
+
+            uint64_t now_us() { return clock_us; }
+            void advance_us(uint64_t us) { clock_us += us; }
+
+            void reset()
+            {
+                  clock_us = 0;
+                  high_frequency_requests = 0;
+                  pin_edges.clear();
+                  preference_store.clear();
+            }
+
+            void clear_preferences() { preference_store.clear(); }
+
+            uint32_t loop_interval_us() { return high_frequency_requests > 0 ? HIGH_FREQUENCY_LOOP_US : LOOP_INTERVAL_US; }
+
+            void HostPin::digital_write(bool value)
+            {
+                  if (value == this->level_)
+                        return;
+                  this->level_ = value;
+                  pin_edges.push_back({clock_us, this->pin_, value});
+                  if (this->on_write)
+                        this->on_write(value);
+            }
+      } // namespace host
+} // namespace esphome
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "esphome/core/gpio.h"
+
+/*
+      The host side of the ESPHome stand-ins in test/stubs: the simulated clock, GPIO pins that remember every edge and
+            the loop() cadence ESPHome would run at.
+*/
+namespace esphome
+{
+  namespace host
+  {
+    // Simulated time since "boot"
+    uint64_t now_us();
+    void advance_us(uint64_t us);
+    // Back to t = 0 with nothing stored; for starting a fresh run in the same process
+    void reset();
+    void clear_preferences();
+
+    // ESPHome calls loop() every 16ms, or back to back while a HighFrequencyLoopRequester is started. We call that 1ms
+    static const uint32_t LOOP_INTERVAL_US = 16000;
+    static const uint32_t HIGH_FREQUENCY_LOOP_US = 1000;
+    uint32_t loop_interval_us();
+
+    // One level change on one pin
+    struct PinEdge
+    {
+      uint64_t at_us;
+      uint8_t pin;
+      bool level;
+    };
+    // Every edge on every HostPin, in order
+    extern std::vector<PinEdge> pin_edges;
+
+    /*
+          A GPIO that isn't connected to anything but the harness. Writes that don't change the level aren't edges and
+                aren't recorded. on_write is called on every edge; the simulated controller hangs off it.
+    */
+    class HostPin : public GPIOPin
+    {
+    public:
+      explicit HostPin(uint8_t pin) : pin_(pin) {}
+      void setup() override { this->pin_mode(gpio::FLAG_OUTPUT); }
+      void pin_mode(gpio::Flags flags) override { this->flags_ = flags; }
+      bool digital_read() override { return this->level_; }
+      void digital_write(bool value) override;
+      std::string dump_summary() const override { return "GPIO" + std::to_string(this->pin_) + " (host)"; }
+
+      uint8_t get_pin() const { return this->pin_; }
+      std::function<void(bool level)> on_write;
+
+    protected:
+      uint8_t pin_;
+      gpio::Flags flags_{gpio::FLAG_NONE};
+      // Pulled up until something drives it
+      bool level_{true};
+    };
+  } // namespace host
+} // namespace esphome
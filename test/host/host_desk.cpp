@@ -0,0 +1,65 @@
+#include <chrono>
+
+#include "host_desk.h"
+
+namespace esphome
+{
+      namespace host
+      {
+            HostDesk::HostDesk()
+            {
+                  this->desk.set_uart_parent(&this->uart);
+                  this->desk.set_hc0_pin(&this->pins[0]);
+                  this->desk.set_hc1_pin(&this->pins[1]);
+                  this->desk.set_hc2_pin(&this->pins[2]);
+                  this->desk.set_hc3_pin(&this->pins[3]);
+
+                  this->desk.set_height_sensor(&this->height);
+                  this->desk.set_raw_height_sensor(&this->raw_height);
+                  this->desk.set_velocity_sensor(&this->velocity);
+                  this->desk.set_time_to_target_sensor(&this->time_to_target);
+                  this->desk.set_target_error_sensor(&this->target_error);
+                  this->desk.set_moving_binary_sensor(&this->moving);
+                  this->desk.set_units_text_sensor(&this->units);
+                  this->desk.set_error_text_sensor(&this->error);
+            }
+
+            void HostDesk::run_for(uint32_t ms)
+            {
+                  uint64_t until = now_us() + (uint64_t)ms * 1000;
+                  while (now_us() < until)
+                  {
+                        if (this->before_loop)
+                              this->before_loop(now_us());
+
+                        auto started = std::chrono::steady_clock::now();
+                        this->desk.loop();
+                        uint64_t took = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+
+                        this->loop_stats.calls++;
+                        this->loop_stats.total_ns += took;
+                        if (took > this->loop_stats.max_ns)
+                              this->loop_stats.max_ns = took;
+
+                        advance_us(loop_interval_us());
+                  }
+            }
+
+            uint8_t make_controller_frame(uint8_t *frame, uint8_t cmd, const uint8_t *params, uint8_t param_len)
+            {
+                  frame[0] = fully_jarvis_cb2c::JARVIS_ADDR_CONTROLLER;
+                  frame[1] = fully_jarvis_cb2c::JARVIS_ADDR_CONTROLLER;
+                  frame[2] = cmd;
+                  frame[3] = param_len;
+                  uint8_t sum = cmd + param_len;
+                  for (uint8_t i = 0; i < param_len; i++)
+                  {
+                        frame[4 + i] = params[i];
+                        sum += params[i];
+                  }
+                  frame[4 + param_len] = sum;
+                  frame[5 + param_len] = fully_jarvis_cb2c::JARVIS_EOM;
+                  return param_len + fully_jarvis_cb2c::JARVIS_FRAME_OVERHEAD;
+            }
+      } // namespace host
+} // namespace esphome
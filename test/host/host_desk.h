@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+
+#include "host.h"
+#include "fully_jarvis_cb2c.h"
+
+namespace esphome
+{
+  namespace host
+  {
+    // Host CPU time spent in loop(), as opposed to the simulated time the component sees through micros()
+    struct LoopStats
+    {
+      uint32_t calls;
+      uint64_t total_ns;
+      uint64_t max_ns;
+    };
+
+    /*
+          A desk wired up the way the YAML would: UART, hc0..hc3 and the sensors the tests look at. Nothing is connected
+                to the other end of the UART or the pins; a capture replay or the simulated controller fills that in
+                through before_loop / uart.on_tx / pins[].on_write.
+    */
+    class HostDesk
+    {
+    public:
+      HostDesk();
+
+      void setup() { this->desk.setup(); }
+      // Call loop() at the cadence ESPHome would until $ms of simulated time have gone by
+      void run_for(uint32_t ms);
+      // Write $frame to the desk as though the controller had sent it
+      void send(const uint8_t *frame, uint8_t len) { this->uart.inject(frame, len); }
+
+      fully_jarvis_cb2c::JarvisCB2CSensor desk;
+      uart::UARTComponent uart;
+      HostPin pins[4]{HostPin(0), HostPin(1), HostPin(2), HostPin(3)};
+
+      sensor::Sensor height{"Height"};
+      sensor::Sensor raw_height{"Raw Height"};
+      sensor::Sensor velocity{"Velocity"};
+      sensor::Sensor time_to_target{"Time To Target"};
+      sensor::Sensor target_error{"Target Error"};
+      binary_sensor::BinarySensor moving{"Moving"};
+      text_sensor::TextSensor units{"Units"};
+      text_sensor::TextSensor error{"Error"};
+
+      // Called with the simulated time before every loop()
+      std::function<void(uint64_t now_us)> before_loop;
+      LoopStats loop_stats{};
+    };
+
+    // A controller frame (0xF2F2 ...) with the checksum filled in; returns its length
+    uint8_t make_controller_frame(uint8_t *frame, uint8_t cmd, const uint8_t *params, uint8_t param_len);
+  } // namespace host
+} // namespace esphome
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "host/capture.h"
+#include "host/host_desk.h"
+#include "esphome/core/log.h"
+
+/*
+      Replays a recorded capture (see host/capture.h) through loop() and reports what the parser and controller made of it:
+            frames parsed, checksum failures, host CPU per loop() and every hc edge the desk drove.
+
+      usage: cb2c_replay <capture> [-v] [--trace [--desk N]] [--dump-trace FILE] [--expect-frames N]
+                        [--expect-checksum-failures N] [--expect-height METERS]
+            -v logs everything the component logs at DEBUG and up. --trace reads <capture> as a device log with dump_trace()
+            output in it (only desk N's frames, on a hub) rather than a capture file. --dump-trace turns the trace on and
+            writes a dump_trace() of the run to FILE, the way the device's logger would. The --expect options make it exit
+            non-zero on a mismatch, which is how ctest runs it.
+*/
+using namespace esphome;
+
+static const char *HC_NAMES[] = {"hc0 (DOWN)", "hc1 (UP)", "hc2", "hc3"};
+
+static const char *USAGE = "usage: %s <capture> [-v] [--trace [--desk N]] [--dump-trace FILE] [--expect-frames N] "
+                           "[--expect-checksum-failures N] [--expect-height METERS]\n";
+// Enough to hold every frame, pin change and decision of a capture a few minutes long
+static const uint16_t dump_trace_size = 4096;
+
+static bool run_call(host::HostDesk &bench, const host::CaptureEvent &event)
+{
+      const char *arg = event.arg.c_str();
+      if (event.call == "goto_height")
+            bench.desk.goto_height(atof(arg));
+      else if (event.call == "goto_preset")
+            bench.desk.goto_preset(atoi(arg));
+      else if (event.call == "stop")
+            bench.desk.stop();
+      else if (event.call == "jog")
+            bench.desk.do_manual_move(arg[0]);
+      else if (event.call == "dump_stats")
+            bench.desk.dump_stats();
+      else
+            return false;
+      return true;
+}
+
+int main(int argc, char **argv)
+{
+      const char *path = nullptr;
+      bool trace = false;
+      int desk = -1;
+      const char *dump_path = nullptr;
+      long expect_frames = -1;
+      long expect_checksum_failures = -1;
+      double expect_height = -1;
+      for (int i = 1; i < argc; i++)
+      {
+            if (!strcmp(argv[i], "-v"))
+                  host_log_level = ESPHOME_LOG_LEVEL_DEBUG;
+            else if (!strcmp(argv[i], "--trace"))
+                  trace = true;
+            else if (!strcmp(argv[i], "--desk") && i + 1 < argc)
+                  desk = atoi(argv[++i]);
+            else if (!strcmp(argv[i], "--dump-trace") && i + 1 < argc)
+                  dump_path = argv[++i];
+            else if (!strcmp(argv[i], "--expect-frames") && i + 1 < argc)
+                  expect_frames = atol(argv[++i]);
+            else if (!strcmp(argv[i], "--expect-checksum-failures") && i + 1 < argc)
+                  expect_checksum_failures = atol(argv[++i]);
+            else if (!strcmp(argv[i], "--expect-height") && i + 1 < argc)
+                  expect_height = atof(argv[++i]);
+            else if (path == nullptr && argv[i][0] != '-')
+                  path = argv[i];
+            else
+            {
+                  fprintf(stderr, USAGE, argv[0]);
+                  return 2;
+            }
+      }
+      if (path == nullptr)
+      {
+            fprintf(stderr, USAGE, argv[0]);
+            return 2;
+      }
+
+      std::vector<host::CaptureEvent> events;
+      std::string error;
+      if (!(trace ? host::load_trace(path, events, error, desk) : host::load_capture(path, events, error)))
+      {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 2;
+      }
+
+      host::HostDesk bench;
+      size_t next = 0;
+      size_t bytes = 0;
+      bool bad_call = false;
+      bench.before_loop = [&](uint64_t now_us) {
+            while (next < events.size() && (uint64_t)events[next].at_ms * 1000 <= now_us)
+            {
+                  const host::CaptureEvent &event = events[next++];
+                  if (event.call.empty())
+                  {
+                        bench.uart.inject(event.bytes.data(), event.bytes.size());
+                        bytes += event.bytes.size();
+                  }
+                  else if (!run_call(bench, event))
+                  {
+                        fprintf(stderr, "%s: unknown call '%s' at %u ms\n", path, event.call.c_str(), event.at_ms);
+                        bad_call = true;
+                  }
+            }
+      };
+
+      if (dump_path != nullptr)
+            bench.desk.set_trace_size(dump_trace_size);
+      bench.setup();
+      // Run past the last event long enough for anything it started to play out
+      uint32_t last_ms = events.empty() ? 0 : events.back().at_ms;
+      bench.run_for(last_ms + 2000);
+      if (bad_call)
+            return 2;
+
+      if (dump_path != nullptr)
+      {
+            FILE *dump = fopen(dump_path, "w");
+            if (dump == nullptr)
+            {
+                  fprintf(stderr, "%s: can't write\n", dump_path);
+                  return 2;
+            }
+            int level = host_log_level;
+            host_log_level = ESPHOME_LOG_LEVEL_INFO;
+            host_log_file = dump;
+            bench.desk.dump_trace();
+            host_log_file = nullptr;
+            host_log_level = level;
+            fclose(dump);
+      }
+
+      const fully_jarvis_cb2c::FrameParser &parser = bench.desk.get_parser();
+      const host::LoopStats &loops = bench.loop_stats;
+      double loop_secs = loops.total_ns * 1e-9;
+
+      printf("Replayed %s: %zu bytes over %.3f s\n", path, bytes, host::now_us() * 1e-6);
+      printf("Frames: %u parsed, %u checksum failures, %u bytes dropped\n", parser.frames, parser.checksum_failures, parser.dropped_bytes);
+      printf("loop(): %u calls, avg %.2f us, max %.2f us host CPU; %.0f frames/s of loop() time\n", loops.calls,
+             loops.calls ? loops.total_ns * 1e-3 / loops.calls : 0, loops.max_ns * 1e-3, loop_secs > 0 ? parser.frames / loop_secs : 0);
+      if (bench.height.has_state())
+            printf("Height: %.4f m (%u publishes)\n", bench.height.state, bench.height.publishes);
+      else
+            printf("Height: never published\n");
+
+      printf("GPIO edges: %zu\n", host::pin_edges.size());
+      for (const host::PinEdge &edge : host::pin_edges)
+            printf("  %10.3f ms  %-10s %s\n", edge.at_us / 1000.0, HC_NAMES[edge.pin], edge.level ? "released" : "pressed");
+
+      int failed = 0;
+      if (expect_frames >= 0 && parser.frames != (uint32_t)expect_frames)
+      {
+            printf("FAIL: expected %ld frames\n", expect_frames);
+            failed = 1;
+      }
+      if (expect_checksum_failures >= 0 && parser.checksum_failures != (uint32_t)expect_checksum_failures)
+      {
+            printf("FAIL: expected %ld checksum failures\n", expect_checksum_failures);
+            failed = 1;
+      }
+      if (expect_height >= 0 && (!bench.height.has_state() || fabs(bench.height.state - expect_height) > .00005))
+      {
+            printf("FAIL: expected a height of %.4f m\n", expect_height);
+            failed = 1;
+      }
+      return failed;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+#include "esphome/core/component.h"
+
+namespace esphome
+{
+  namespace binary_sensor
+  {
+    // Host stand-in; remembers the last state and counts publishes
+    class BinarySensor
+    {
+    public:
+      explicit BinarySensor(const std::string &name = "") : name_(name) {}
+      void publish_state(bool state)
+      {
+        this->state = state;
+        this->publishes++;
+      }
+      const std::string &get_name() const { return this->name_; }
+
+      bool state{false};
+      uint32_t publishes{0};
+
+    protected:
+      std::string name_;
+    };
+  } // namespace binary_sensor
+} // namespace esphome
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+#include "esphome/core/component.h"
+
+namespace esphome
+{
+  namespace sensor
+  {
+    // Host stand-in; remembers the last state and counts publishes
+    class Sensor
+    {
+    public:
+      explicit Sensor(const std::string &name = "") : name_(name) {}
+      void publish_state(float state)
+      {
+        this->state = state;
+        this->has_state_ = true;
+        this->publishes++;
+      }
+      bool has_state() const { return this->has_state_; }
+      float get_state() const { return this->state; }
+      const std::string &get_name() const { return this->name_; }
+
+      float state{0.0f};
+      uint32_t publishes{0};
+
+    protected:
+      std::string name_;
+      bool has_state_{false};
+    };
+  } // namespace sensor
+} // namespace esphome
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+#include "esphome/core/component.h"
+
+namespace esphome
+{
+  namespace text_sensor
+  {
+    // Host stand-in; remembers the last state and counts publishes
+    class TextSensor
+    {
+    public:
+      explicit TextSensor(const std::string &name = "") : name_(name) {}
+      void publish_state(const std::string &state)
+      {
+        this->state = state;
+        this->publishes++;
+      }
+      const std::string &get_name() const { return this->name_; }
+
+      std::string state;
+      uint32_t publishes{0};
+
+    protected:
+      std::string name_;
+    };
+  } // namespace text_sensor
+} // namespace esphome
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "esphome/core/component.h"
+
+namespace esphome
+{
+  namespace uart
+  {
+    /*
+          Host stand-in for the UART bus. The harness queues bytes for the desk to read with inject(); whatever the desk
+                writes is kept in tx and handed to on_tx (the simulated controller, say) as it's written.
+    */
+    class UARTComponent
+    {
+    public:
+      void inject(const uint8_t *data, size_t len) { this->rx.insert(this->rx.end(), data, data + len); }
+      void inject(uint8_t b) { this->rx.push_back(b); }
+
+      void write_array(const uint8_t *data, size_t len)
+      {
+        this->tx.insert(this->tx.end(), data, data + len);
+        if (this->on_tx)
+          this->on_tx(data, len);
+      }
+      bool read_byte(uint8_t *data)
+      {
+        if (this->rx.empty())
+          return false;
+        *data = this->rx.front();
+        this->rx.pop_front();
+        return true;
+      }
+      int available() const { return this->rx.size(); }
+
+      std::deque<uint8_t> rx;
+      std::vector<uint8_t> tx;
+      std::function<void(const uint8_t *data, size_t len)> on_tx;
+    };
+
+    class UARTDevice
+    {
+    public:
+      UARTDevice() = default;
+      explicit UARTDevice(UARTComponent *parent) : parent_(parent) {}
+      void set_uart_parent(UARTComponent *parent) { this->parent_ = parent; }
+
+      void write_byte(uint8_t data) { this->parent_->write_array(&data, 1); }
+      void write_array(const uint8_t *data, size_t len) { this->parent_->write_array(data, len); }
+      bool read_byte(uint8_t *data) { return this->parent_->read_byte(data); }
+      int available() { return this->parent_->available(); }
+
+    protected:
+      UARTComponent *parent_{nullptr};
+    };
+  } // namespace uart
+} // namespace esphome
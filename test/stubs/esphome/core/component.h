@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "esphome/core/gpio.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+
+// Host stand-in; enough of Component for setup() / loop() / dump_config() to be called by hand
+namespace esphome
+{
+  namespace setup_priority
+  {
+    extern const float BUS;
+    extern const float DATA;
+    extern const float LATE;
+  } // namespace setup_priority
+
+  class Component
+  {
+  public:
+    virtual ~Component() = default;
+    virtual void setup() {}
+    virtual void loop() {}
+    virtual void dump_config() {}
+    virtual float get_setup_priority() const { return setup_priority::DATA; }
+
+    void status_set_warning() { this->warning_ = true; }
+    void status_clear_warning() { this->warning_ = false; }
+    bool status_has_warning() const { return this->warning_; }
+    void mark_failed() { this->failed_ = true; }
+    bool is_failed() const { return this->failed_; }
+
+  protected:
+    bool warning_{false};
+    bool failed_{false};
+  };
+
+  // ESPHome runs loop() flat out while any of these are started, every ~16ms otherwise. host::loop_interval_us() follows suit
+  class HighFrequencyLoopRequester
+  {
+  public:
+    void start();
+    void stop();
+    static bool is_high_frequency();
+
+  protected:
+    bool started_{false};
+  };
+} // namespace esphome
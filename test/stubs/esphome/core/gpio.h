@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace esphome
+{
+  namespace gpio
+  {
+    enum Flags : uint8_t
+    {
+      FLAG_NONE = 0x00,
+      FLAG_INPUT = 0x01,
+      FLAG_OUTPUT = 0x02,
+    };
+  } // namespace gpio
+
+  // Same interface as ESPHome's; the harness provides the implementation (host::HostPin)
+  class GPIOPin
+  {
+  public:
+    virtual ~GPIOPin() = default;
+    virtual void setup() = 0;
+    virtual void pin_mode(gpio::Flags flags) = 0;
+    virtual bool digital_read() = 0;
+    virtual void digital_write(bool value) = 0;
+    virtual std::string dump_summary() const = 0;
+    virtual bool is_internal() { return false; }
+  };
+
+  class InternalGPIOPin : public GPIOPin
+  {
+  public:
+    bool is_internal() override { return true; }
+    virtual uint8_t get_pin() const = 0;
+    virtual bool is_inverted() const = 0;
+  };
+} // namespace esphome
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+      Host stand-in. Time only moves when the harness moves it (host::advance_us()), so a replay or simulation runs the same
+            way every time however fast the machine is. delay() just moves the clock along.
+*/
+namespace esphome
+{
+  uint32_t millis();
+  uint32_t micros();
+  void delay(uint32_t ms);
+  void delayMicroseconds(uint32_t us);
+} // namespace esphome
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Host stand-in; just the helpers the component uses, behaving the way ESPHome's do
+namespace esphome
+{
+  // FNV-1, same as ESPHome, so preference keys come out the same as on the device
+  uint32_t fnv1_hash(const std::string &str);
+  std::string format_hex(const uint8_t *data, size_t length);
+
+  template<typename T> T clamp(T val, T min, T max)
+  {
+    if (val < min)
+      return min;
+    if (val > max)
+      return max;
+    return val;
+  }
+
+  template<typename... X> class CallbackManager;
+  template<typename... Ts> class CallbackManager<void(Ts...)>
+  {
+  public:
+    void add(std::function<void(Ts...)> &&callback) { this->callbacks_.push_back(std::move(callback)); }
+    void call(Ts... args)
+    {
+      for (auto &cb : this->callbacks_)
+        cb(args...);
+    }
+    size_t size() const { return this->callbacks_.size(); }
+
+  protected:
+    std::vector<std::function<void(Ts...)>> callbacks_;
+  };
+} // namespace esphome
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "esphome/core/helpers.h"
+
+/*
+      Host stand-in. Everything goes to stderr (or host_log_file, if set), filtered by host_log_level
+            (ESPHOME_LOG_LEVEL_NONE by default so a benchmark isn't timing printf). The format checks are the same as on the
+            device.
+*/
+#define ESPHOME_LOG_LEVEL_NONE 0
+#define ESPHOME_LOG_LEVEL_ERROR 1
+#define ESPHOME_LOG_LEVEL_WARN 2
+#define ESPHOME_LOG_LEVEL_INFO 3
+#define ESPHOME_LOG_LEVEL_CONFIG 4
+#define ESPHOME_LOG_LEVEL_DEBUG 5
+#define ESPHOME_LOG_LEVEL_VERBOSE 6
+#define ESPHOME_LOG_LEVEL_VERY_VERBOSE 7
+
+namespace esphome
+{
+  extern int host_log_level;
+  extern FILE *host_log_file;
+  void host_log(int level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+} // namespace esphome
+
+#define ESP_LOGE(tag, ...) ::esphome::host_log(ESPHOME_LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) ::esphome::host_log(ESPHOME_LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) ::esphome::host_log(ESPHOME_LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...) ::esphome::host_log(ESPHOME_LOG_LEVEL_CONFIG, tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) ::esphome::host_log(ESPHOME_LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) ::esphome::host_log(ESPHOME_LOG_LEVEL_VERBOSE, tag, __VA_ARGS__)
+#define ESP_LOGVV(tag, ...) ::esphome::host_log(ESPHOME_LOG_LEVEL_VERY_VERBOSE, tag, __VA_ARGS__)
+
+#define YESNO(b) ((b) ? "YES" : "NO")
+#define ONOFF(b) ((b) ? "ON" : "OFF")
+
+#define LOG_PIN(prefix, pin) \
+  if ((pin) != nullptr) \
+    ESP_LOGCONFIG(TAG, prefix "%s", (pin)->dump_summary().c_str());
+#define LOG_SENSOR(prefix, type, obj) \
+  if ((obj) != nullptr) \
+    ESP_LOGCONFIG(TAG, "%s%s '%s'", prefix, type, (obj)->get_name().c_str());
+#define LOG_BINARY_SENSOR(prefix, type, obj) LOG_SENSOR(prefix, type, obj)
+#define LOG_TEXT_SENSOR(prefix, type, obj) LOG_SENSOR(prefix, type, obj)
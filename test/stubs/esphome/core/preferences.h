@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+      Host stand-in. Preferences live in memory for as long as the process does, so a test can tear a desk down and build
+            a new one to see what it restores after a "reboot". host::clear_preferences() wipes them.
+*/
+namespace esphome
+{
+  class ESPPreferenceObject
+  {
+  public:
+    ESPPreferenceObject() = default;
+    ESPPreferenceObject(uint32_t key, size_t size) : key_(key), size_(size) {}
+
+    template<typename T> bool save(const T *src) { return this->save_(src, sizeof(T)); }
+    template<typename T> bool load(T *dest) { return this->load_(dest, sizeof(T)); }
+
+  protected:
+    bool save_(const void *src, size_t size);
+    bool load_(void *dest, size_t size);
+
+    uint32_t key_{0};
+    size_t size_{0};
+  };
+
+  class ESPPreferences
+  {
+  public:
+    template<typename T> ESPPreferenceObject make_preference(uint32_t type, bool in_flash) { return {type, sizeof(T)}; }
+    template<typename T> ESPPreferenceObject make_preference(uint32_t type) { return {type, sizeof(T)}; }
+    bool sync() { return true; }
+  };
+
+  extern ESPPreferences *global_preferences;
+} // namespace esphome
@@ -0,0 +1,143 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host/desk_sim.h"
+#include "esphome/core/log.h"
+
+/*
+      goto_height() against the simulated desk, over a sweep of start / target heights, so a change to _adjust_height() can
+            be judged on numbers. The sweep runs twice: once from the default motion model and once more with whatever
+            the first pass taught it, since that's what a desk that's been in use for a while will be doing.
+
+      Every column is ground truth from the simulation, not what the reports said:
+            time        goto_height() until the desk stopped moving for the last time
+            error       where it stopped minus the target
+            overshoot   furthest past the target in the direction it set off in
+            reversals   times it changed direction
+            presses     button presses, the first one included
+
+      usage: cb2c_sweep [--inch] [-v] [--max-error-mm X] [--max-time-s X]
+            The --max options make it exit non-zero if any move misses them, which is how ctest runs it.
+*/
+using namespace esphome;
+using namespace esphome::fully_jarvis_cb2c;
+
+struct MoveResult
+{
+      bool finished;
+      double time_s;
+      double error_mm;
+      double overshoot_mm;
+      uint32_t reversals;
+      uint32_t presses;
+};
+
+// Give up on a move that hasn't finished by then; the component gives up on a press after 30s itself
+static const uint32_t move_timeout_ms = 60000;
+
+static MoveResult run_move(uint8_t units, int32_t start_tmm, int32_t target_tmm)
+{
+      MoveResult result{};
+      // A new desk for each move, so every one starts from rest at $start_tmm. The preferences carry over like a reboot,
+      //    so the motion model keeps what it has learned
+      host::HostDesk bench;
+      host::DeskSim sim(bench, units, start_tmm);
+      bench.setup();
+      bench.run_for(1500);
+
+      sim.reset_stats();
+      host::pin_edges.clear();
+      uint64_t started_us = host::now_us();
+      uint32_t results_before = bench.time_to_target.publishes;
+      bench.desk.goto_height(target_tmm / 100.0);
+
+      uint32_t waited = 0;
+      while (bench.time_to_target.publishes == results_before && waited < move_timeout_ms)
+      {
+            bench.run_for(100);
+            waited += 100;
+      }
+      // Let anything still coasting come to rest
+      bench.run_for(1000);
+
+      int8_t dir = target_tmm > start_tmm ? 1 : -1;
+      double past = dir > 0 ? sim.highest_tmm() - target_tmm : target_tmm - sim.lowest_tmm();
+      result.finished = bench.time_to_target.publishes != results_before;
+      result.time_s = (sim.last_moving_us() - started_us) * 1e-6;
+      result.error_mm = (sim.height_tmm() - target_tmm) * .1;
+      result.overshoot_mm = past > 0 ? past * .1 : 0;
+      result.reversals = sim.reversals();
+      for (const host::PinEdge &edge : host::pin_edges)
+            if (!edge.level)
+                  result.presses++;
+      return result;
+}
+
+int main(int argc, char **argv)
+{
+      uint8_t units = JARVIS_UNITS_CM;
+      double max_error_mm = -1;
+      double max_time_s = -1;
+      for (int i = 1; i < argc; i++)
+      {
+            if (!strcmp(argv[i], "--inch"))
+                  units = JARVIS_UNITS_INCH;
+            else if (!strcmp(argv[i], "-v"))
+                  host_log_level = ESPHOME_LOG_LEVEL_DEBUG;
+            else if (!strcmp(argv[i], "--max-error-mm") && i + 1 < argc)
+                  max_error_mm = atof(argv[++i]);
+            else if (!strcmp(argv[i], "--max-time-s") && i + 1 < argc)
+                  max_time_s = atof(argv[++i]);
+            else
+            {
+                  fprintf(stderr, "usage: %s [--inch] [-v] [--max-error-mm X] [--max-time-s X]\n", argv[0]);
+                  return 2;
+            }
+      }
+
+      // Long moves both ways, the ones that end in the nudge zone and a couple that start at the ends of travel. tmm
+      static const int32_t moves[][2] = {
+          {7200, 11000}, {11000, 7200}, {6500, 12500}, {12500, 6500}, {9000, 9500}, {9500, 9000},
+          {8000, 8200}, {8200, 8000}, {10000, 10060}, {10060, 10000}, {6200, 7500}, {12700, 11400},
+          {7500, 10000}, {10000, 7500}, {9000, 12000}, {12000, 9000},
+      };
+      static const size_t move_count = sizeof(moves) / sizeof(moves[0]);
+
+      host::reset();
+      int failed = 0;
+      for (uint8_t pass = 1; pass <= 2; pass++)
+      {
+            printf("\nPass %u, %s, %s\n", pass, units == JARVIS_UNITS_INCH ? "inch" : "mm",
+                   pass == 1 ? "from the default motion model" : "after learning from pass 1");
+            printf("  start cm  target cm    time s  error mm  overshoot mm  reversals  presses\n");
+
+            double total_time = 0, total_abs_error = 0, worst_error = 0, worst_overshoot = 0;
+            uint32_t total_reversals = 0, unfinished = 0;
+            for (size_t m = 0; m < move_count; m++)
+            {
+                  MoveResult r = run_move(units, moves[m][0], moves[m][1]);
+                  printf("  %8.1f  %9.1f  %8.2f  %8.1f  %12.1f  %9u  %7u%s\n", moves[m][0] * .01, moves[m][1] * .01, r.time_s,
+                         r.error_mm, r.overshoot_mm, r.reversals, r.presses, r.finished ? "" : "  (never finished)");
+
+                  total_time += r.time_s;
+                  total_abs_error += fabs(r.error_mm);
+                  total_reversals += r.reversals;
+                  if (fabs(r.error_mm) > worst_error)
+                        worst_error = fabs(r.error_mm);
+                  if (r.overshoot_mm > worst_overshoot)
+                        worst_overshoot = r.overshoot_mm;
+                  unfinished += !r.finished;
+
+                  if (!r.finished || (max_error_mm >= 0 && fabs(r.error_mm) > max_error_mm) || (max_time_s >= 0 && r.time_s > max_time_s))
+                        failed = 1;
+            }
+            printf("  avg time %.2f s, avg |error| %.2f mm, worst |error| %.2f mm, worst overshoot %.1f mm, %u reversals, %u unfinished\n",
+                   total_time / move_count, total_abs_error / move_count, worst_error, worst_overshoot, total_reversals, unfinished);
+      }
+
+      if (failed)
+            printf("\nFAIL: a move didn't finish or was outside --max-error-mm / --max-time-s\n");
+      return failed;
+}
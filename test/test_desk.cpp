@@ -0,0 +1,465 @@
+#include <functional>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "host/check.h"
+#include "host/desk_sim.h"
+#include "cb2c_hub.h"
+
+/*
+      Regression tests for the component. Most use hand built frames, so nothing moves unless the test says it did; the
+            ones at the end run against the simulated desk.
+*/
+using namespace esphome;
+using namespace esphome::fully_jarvis_cb2c;
+
+static void send(host::HostDesk &bench, uint8_t cmd, std::initializer_list<uint8_t> params)
+{
+      uint8_t frame[JARVIS_PACKET_MAX_LEN];
+      uint8_t len = host::make_controller_frame(frame, cmd, params.begin(), params.size());
+      bench.send(frame, len);
+}
+
+// Raw height in tenths of a cm, so mm
+static void send_height(host::HostDesk &bench, uint16_t raw)
+{
+      send(bench, JARVIS_CMD_HEIGHT, {(uint8_t)(raw >> 8), (uint8_t)raw, 0x00});
+}
+
+static size_t count_sent(const host::HostDesk &bench, const TxFrame &frame)
+{
+      size_t n = 0;
+      const std::vector<uint8_t> &tx = bench.uart.tx;
+      for (size_t i = 0; i + frame.len <= tx.size(); i++)
+            if (!memcmp(&tx[i], frame.data, frame.len))
+                  n++;
+      return n;
+}
+
+// HostDesk::run_for() for desks on a hub; their own loop() leaves the polling to the hub
+static void run_hub(JarvisCB2CHub &hub, uint32_t ms)
+{
+      uint64_t until = host::now_us() + (uint64_t)ms * 1000;
+      while (host::now_us() < until)
+      {
+            hub.loop();
+            host::advance_us(host::loop_interval_us());
+      }
+}
+
+static size_t edges_on(uint8_t pin, bool level)
+{
+      size_t n = 0;
+      for (const host::PinEdge &edge : host::pin_edges)
+            if (edge.pin == pin && edge.level == level)
+                  n++;
+      return n;
+}
+
+static void test_asks_for_height_at_boot()
+{
+      host::HostDesk bench;
+      bench.setup();
+      bench.run_for(100);
+      CHECK(count_sent(bench, make_handset_frame(JARVIS_CMD_WAKE)) >= 1);
+      CHECK(count_sent(bench, make_handset_frame(JARVIS_CMD_SETTINGS)) >= 1);
+}
+
+static void test_height_report_is_published()
+{
+      host::HostDesk bench;
+      bench.setup();
+      send(bench, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+      send_height(bench, 720);
+      bench.run_for(50);
+      CHECK(bench.height.has_state());
+      CHECK(fabs(bench.height.state - 0.72f) < 0.00005f);
+      CHECK_EQ(bench.raw_height.state, 720);
+      CHECK(bench.units.state == "cm");
+}
+
+static void test_first_report_is_not_motion()
+{
+      host::HostDesk bench;
+      uint32_t starts = 0;
+      bench.desk.add_on_motion_start_callback([&starts]() { starts++; });
+      bench.setup();
+      bench.run_for(100);
+      send(bench, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+      send_height(bench, 720);
+      bench.run_for(1000);
+      CHECK_EQ(starts, 0);
+      CHECK(!bench.moving.state);
+
+      send_height(bench, 725);
+      bench.run_for(50);
+      CHECK_EQ(starts, 1);
+      CHECK(bench.moving.state);
+}
+
+static void test_resyncs_after_corrupt_frame()
+{
+      host::HostDesk bench;
+      bench.setup();
+      // A height report with its checksum knocked off by one, then a good one
+      const uint8_t corrupt[] = {0xF2, 0xF2, 0x01, 0x03, 0x02, 0xD0, 0x00, 0xD7, 0x7E};
+      bench.send(corrupt, sizeof(corrupt));
+      send_height(bench, 730);
+      bench.run_for(50);
+      CHECK_EQ(bench.desk.get_parser().checksum_failures, 1);
+      CHECK_EQ(bench.desk.get_parser().frames, 1);
+      CHECK(fabs(bench.height.state - 0.73f) < 0.00005f);
+}
+
+static void test_goto_height_waits_for_a_height()
+{
+      host::HostDesk bench;
+      bench.setup();
+      bench.desk.goto_height(100);
+      bench.run_for(500);
+      CHECK_EQ(host::pin_edges.size(), 0);
+}
+
+static void test_height_survives_reboot()
+{
+      {
+            host::HostDesk bench;
+            bench.setup();
+            send(bench, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+            send_height(bench, 955);
+            bench.run_for(1000);
+      }
+      host::HostDesk rebooted;
+      rebooted.setup();
+      CHECK(rebooted.height.has_state());
+      CHECK(fabs(rebooted.height.state - 0.955f) < 0.00005f);
+}
+
+static void test_hub_desks_keep_their_own_height()
+{
+      {
+            JarvisCB2CHub hub;
+            host::HostDesk left, right;
+            left.desk.set_log_tag("jarvis.left");
+            right.desk.set_log_tag("jarvis.right");
+            hub.add_desk(&left.desk);
+            hub.add_desk(&right.desk);
+            hub.setup();
+            left.setup();
+            right.setup();
+
+            send(left, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+            send_height(left, 720);
+            send(right, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+            send_height(right, 1100);
+            run_hub(hub, 1000);
+            CHECK(fabs(left.height.state - 0.72f) < 0.00005f);
+            CHECK(fabs(right.height.state - 1.1f) < 0.00005f);
+      }
+
+      // Same desks, same order after the reboot; each has to come back with its own height, not whichever saved last
+      JarvisCB2CHub hub;
+      host::HostDesk left, right;
+      left.desk.set_log_tag("jarvis.left");
+      right.desk.set_log_tag("jarvis.right");
+      hub.add_desk(&left.desk);
+      hub.add_desk(&right.desk);
+      hub.setup();
+      left.setup();
+      right.setup();
+      CHECK(left.height.has_state() && fabs(left.height.state - 0.72f) < 0.00005f);
+      CHECK(right.height.has_state() && fabs(right.height.state - 1.1f) < 0.00005f);
+}
+
+static void test_error_abandons_move()
+{
+      host::HostDesk bench;
+      bench.setup();
+      send(bench, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+      send_height(bench, 720);
+      bench.run_for(50);
+
+      bench.desk.goto_height(100);
+      bench.run_for(20);
+      CHECK_EQ(edges_on(1, false), 1);
+      send(bench, JARVIS_CMD_ERROR, {0x01});
+      bench.run_for(20);
+      CHECK_EQ(edges_on(1, true), 1);
+      CHECK(bench.error.state == "E01");
+}
+
+static void test_jog_limit_stop_is_latched()
+{
+      host::HostDesk bench;
+      bench.setup();
+      send(bench, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+      send_height(bench, 720);
+      bench.run_for(50);
+
+      bench.desk.do_manual_move('u');
+      bench.run_for(20);
+      CHECK_EQ(edges_on(1, false), 1);
+      send(bench, JARVIS_CMD_LIMIT_STOP, {0x01});
+      bench.run_for(20);
+      CHECK_EQ(edges_on(1, true), 1);
+
+      // Keepalives for the same direction don't start it again...
+      bench.desk.do_manual_move('u');
+      bench.run_for(20);
+      CHECK_EQ(edges_on(1, false), 1);
+      // ... but the other way does
+      bench.desk.do_manual_move('d');
+      bench.run_for(20);
+      CHECK_EQ(edges_on(0, false), 1);
+      bench.desk.do_manual_move('s');
+      bench.run_for(20);
+      CHECK_EQ(edges_on(0, true), 1);
+}
+
+static void test_move_frame_acked_by_motion()
+{
+      host::HostDesk bench;
+      bench.desk.set_serial_commands(true);
+      bench.setup();
+      send(bench, JARVIS_CMD_UNITS, {JARVIS_UNITS_CM});
+      send_height(bench, 720);
+      bench.run_for(100);
+
+      const TxFrame move_2 = make_handset_frame(JARVIS_CMD_MOVE_2);
+      bench.desk.goto_preset(2);
+      bench.run_for(100);
+      CHECK_EQ(count_sent(bench, move_2), 1);
+
+      // The idle desk repeating its height isn't an answer; it gets sent again
+      send_height(bench, 720);
+      bench.run_for(300);
+      CHECK_EQ(count_sent(bench, move_2), 2);
+
+      // The desk starting to move is
+      send_height(bench, 721);
+      bench.run_for(1000);
+      CHECK_EQ(count_sent(bench, move_2), 2);
+}
+
+static void test_stop_ends_preset_recall()
+{
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_CM, 7200);
+      sim.set_preset(3, 11000);
+      bench.desk.set_serial_commands(true);
+      bench.setup();
+      bench.run_for(1500);
+
+      bench.desk.goto_preset(3);
+      bench.run_for(2000);
+      CHECK(sim.is_moving());
+      bench.desk.stop();
+      bench.run_for(2000);
+      CHECK(!sim.is_moving());
+      CHECK(sim.height_tmm() < 9000);
+
+      // Already stopped; another stop() mustn't nudge it
+      double stopped_at = sim.height_tmm();
+      bench.desk.stop();
+      bench.run_for(2000);
+      CHECK(sim.height_tmm() == stopped_at);
+}
+
+static void test_stop_right_after_preset_recall()
+{
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_CM, 7200);
+      sim.set_preset(3, 11000);
+      bench.desk.set_serial_commands(true);
+      bench.setup();
+      bench.run_for(1500);
+
+      // Before the first height change there's nothing in the reports to say the desk is moving
+      bench.desk.goto_preset(3);
+      bench.run_for(5);
+      bench.desk.stop();
+      bench.run_for(8000);
+      CHECK(!sim.is_moving());
+      CHECK(sim.height_tmm() < 7300);
+}
+
+static void test_stop_drops_unacked_move()
+{
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_CM, 7200);
+      sim.set_preset(3, 11000);
+      bench.desk.set_serial_commands(true);
+      bench.setup();
+      bench.run_for(1500);
+
+      // The first MOVE never arrives; stop() before the retry is due mustn't leave the retry queued
+      sim.drop_next_frames(1);
+      size_t sent = count_sent(bench, make_handset_frame(JARVIS_CMD_MOVE_3));
+      bench.desk.goto_preset(3);
+      bench.run_for(100);
+      bench.desk.stop();
+      bench.run_for(3000);
+      CHECK_EQ(count_sent(bench, make_handset_frame(JARVIS_CMD_MOVE_3)), sent + 1);
+      CHECK(!sim.is_moving());
+      // stop() can't tell the MOVE was lost, so it still taps a button to end the recall; that's a fraction of a mm
+      CHECK(fabs(sim.height_tmm() - 7200) < 10);
+}
+
+static void test_preset_recall_reaches_preset()
+{
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_INCH, 7200);
+      sim.set_preset(2, 9000);
+      bench.desk.set_serial_commands(true);
+      bench.setup();
+      bench.run_for(1500);
+
+      bench.desk.goto_preset(2);
+      bench.run_for(15000);
+      CHECK(fabs(sim.height_tmm() - 9000) < 2);
+      CHECK(fabs(bench.height.state - 0.9f) < 0.0013f);
+}
+
+// Run in 50ms steps until $done() or $ms have gone by
+static bool run_until(host::HostDesk &bench, uint32_t ms, const std::function<bool()> &done)
+{
+      for (uint32_t t = 0; t < ms; t += 50)
+      {
+            if (done())
+                  return true;
+            bench.run_for(50);
+      }
+      return done();
+}
+
+// Every height (cm) the desk stood still at for a second or more over the next $ms, in order
+static std::vector<long> stops(host::HostDesk &bench, host::DeskSim &sim, uint32_t ms)
+{
+      std::vector<long> at;
+      uint32_t still_ms = 0;
+      for (uint32_t t = 0; t < ms; t += 50)
+      {
+            bench.run_for(50);
+            still_ms = sim.is_moving() ? 0 : still_ms + 50;
+            long cm = lround(sim.height_tmm() * .01);
+            if (still_ms == 1000 && (at.empty() || at.back() != cm))
+                  at.push_back(cm);
+      }
+      return at;
+}
+
+static void test_publish_is_throttled_but_ends_settled()
+{
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_CM, 7200);
+      bench.desk.set_publish_hysteresis(100);
+      bench.desk.set_min_publish_interval(1000);
+      bench.setup();
+      bench.run_for(1500);
+
+      // ~7s of travel reported every 50ms, most of it a new mm each time
+      bench.height.publishes = 0;
+      bench.desk.goto_height(100);
+      CHECK(run_until(bench, 15000, [&] { return !sim.is_moving() && fabs(sim.height_tmm() - 10000) < 20; }));
+      bench.run_for(2000);
+      CHECK(bench.height.publishes >= 4);
+      CHECK(bench.height.publishes <= 10);
+
+      // Whatever the throttling held back, the last thing published is where the desk stopped (to the mm it reports)
+      CHECK(fabs(bench.height.state - lround(sim.height_tmm() * .1) * .001f) < 0.00005f);
+}
+
+static void test_sequence_repeats()
+{
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_CM, 7200);
+      bench.setup();
+      bench.run_for(1500);
+
+      bench.desk.add_sequence_height(80, 2);
+      bench.desk.add_sequence_height(75, 2);
+      bench.desk.set_sequence_repeat(2);
+      bench.desk.start_sequence();
+      std::vector<long> at = stops(bench, sim, 40000);
+      CHECK(at == std::vector<long>({80, 75, 80, 75}));
+      CHECK(!bench.desk.is_sequence_running());
+}
+
+static void test_sequence_pause_keeps_the_dwell()
+{
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_CM, 7200);
+      bench.setup();
+      bench.run_for(1500);
+
+      bench.desk.add_sequence_height(80, 10);
+      bench.desk.add_sequence_height(75, 1);
+      bench.desk.start_sequence();
+      CHECK(run_until(bench, 10000, [&] { return !sim.is_moving() && fabs(sim.height_tmm() - 8000) < 20; }));
+
+      // A few seconds into the 10s dwell
+      bench.run_for(4000);
+      bench.desk.pause_sequence();
+      bench.run_for(20000);
+      CHECK(fabs(sim.height_tmm() - 8000) < 20);
+
+      // The rest of the dwell, not all of it again
+      bench.desk.start_sequence();
+      bench.run_for(3000);
+      CHECK(fabs(sim.height_tmm() - 8000) < 20);
+      bench.run_for(6000);
+      CHECK(sim.height_tmm() < 7900);
+      CHECK(run_until(bench, 10000, [&] { return !bench.desk.is_sequence_running(); }));
+      CHECK(fabs(sim.height_tmm() - 7500) < 20);
+}
+
+static void test_sequence_survives_reboot()
+{
+      double cut_at;
+      {
+            host::HostDesk bench;
+            host::DeskSim sim(bench, JARVIS_UNITS_CM, 7200);
+            bench.setup();
+            bench.run_for(1500);
+
+            bench.desk.add_sequence_height(80, 1);
+            bench.desk.add_sequence_height(100, 1);
+            bench.desk.start_sequence();
+            // Power goes on the way to the second step
+            CHECK(run_until(bench, 20000, [&] { return sim.height_tmm() > 8500; }));
+            cut_at = sim.height_tmm();
+      }
+
+      host::HostDesk bench;
+      host::DeskSim sim(bench, JARVIS_UNITS_CM, lround(cut_at));
+      bench.setup();
+      CHECK(bench.desk.is_sequence_running());
+      CHECK(run_until(bench, 20000, [&] { return !bench.desk.is_sequence_running(); }));
+      CHECK(fabs(sim.height_tmm() - 10000) < 20);
+      // Carried on with the step it was on rather than starting over
+      CHECK(sim.lowest_tmm() >= lround(cut_at));
+}
+
+int main()
+{
+      RUN_TEST(test_asks_for_height_at_boot);
+      RUN_TEST(test_height_report_is_published);
+      RUN_TEST(test_first_report_is_not_motion);
+      RUN_TEST(test_resyncs_after_corrupt_frame);
+      RUN_TEST(test_goto_height_waits_for_a_height);
+      RUN_TEST(test_height_survives_reboot);
+      RUN_TEST(test_hub_desks_keep_their_own_height);
+      RUN_TEST(test_error_abandons_move);
+      RUN_TEST(test_jog_limit_stop_is_latched);
+      RUN_TEST(test_move_frame_acked_by_motion);
+      RUN_TEST(test_stop_ends_preset_recall);
+      RUN_TEST(test_stop_right_after_preset_recall);
+      RUN_TEST(test_stop_drops_unacked_move);
+      RUN_TEST(test_preset_recall_reaches_preset);
+      RUN_TEST(test_publish_is_throttled_but_ends_settled);
+      RUN_TEST(test_sequence_repeats);
+      RUN_TEST(test_sequence_pause_keeps_the_dwell);
+      RUN_TEST(test_sequence_survives_reboot);
+      return host::check_failures != 0;
+}
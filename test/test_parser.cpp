@@ -0,0 +1,283 @@
+#include <math.h>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "host/check.h"
+#include "host/host_desk.h"
+
+/*
+      Properties the frame decoder has to hold whatever comes down the wire. Run under ASan / UBSan (the default) any read
+            or write outside the parser's buffers fails the run as well.
+
+      usage: cb2c_test_parser [iterations] [seed]
+*/
+using namespace esphome;
+using namespace esphome::fully_jarvis_cb2c;
+
+static uint32_t iterations = 200000;
+static std::mt19937 rng(1);
+
+static uint8_t random_byte()
+{
+      // Mostly bytes that mean something to the parser, so the noise keeps looking like the start of a frame
+      static const uint8_t interesting[] = {JARVIS_ADDR_CONTROLLER, JARVIS_ADDR_HANDSET, JARVIS_EOM, 0x00, 0x01, 0x02, 0x03, 0x04, 0xFF};
+      if (rng() % 2)
+            return interesting[rng() % sizeof(interesting)];
+      return rng();
+}
+
+// A valid frame from either end, 0 to JARVIS_MAX_PARAMS params
+static std::vector<uint8_t> random_frame()
+{
+      uint8_t params[JARVIS_MAX_PARAMS];
+      uint8_t param_len = rng() % (JARVIS_MAX_PARAMS + 1);
+      for (uint8_t i = 0; i < param_len; i++)
+            params[i] = rng();
+      uint8_t frame[JARVIS_PACKET_MAX_LEN];
+      uint8_t len = host::make_controller_frame(frame, rng(), params, param_len);
+      if (rng() % 2)
+      {
+            // Same thing from the handset; only the address differs
+            frame[0] = frame[1] = JARVIS_ADDR_HANDSET;
+      }
+      return std::vector<uint8_t>(frame, frame + len);
+}
+
+// Everything read_frame() hands out has to be a whole, checksummed frame
+static bool well_formed(const uint8_t *frame, uint8_t len)
+{
+      return len >= JARVIS_FRAME_OVERHEAD && len <= JARVIS_PACKET_MAX_LEN &&
+             (frame[0] == JARVIS_ADDR_CONTROLLER || frame[0] == JARVIS_ADDR_HANDSET) && frame[1] == frame[0] &&
+             frame[3] + JARVIS_FRAME_OVERHEAD == len && frame[len - 1] == JARVIS_EOM && verify_checksum(frame, len);
+}
+
+/*
+      Noise, then a clean frame. The clean frame has to come out the moment its last byte goes in, however the noise
+            ended; resync costs no bytes beyond the frame itself. The one way it can legitimately be missed is when the
+            tail of the noise plus the start of the frame happens to checksum as a frame of its own, so those are counted
+            and have to stay rare.
+*/
+static void test_resyncs_after_random_prefix()
+{
+      FrameParser parser;
+      uint8_t out[JARVIS_PACKET_MAX_LEN];
+      uint32_t swallowed = 0;
+      for (uint32_t i = 0; i < iterations; i++)
+      {
+            uint8_t noise = rng() % 24;
+            for (uint8_t n = 0; n < noise; n++)
+            {
+                  parser.push(random_byte());
+                  while (uint8_t len = parser.read_frame(out))
+                        CHECK(well_formed(out, len));
+            }
+
+            std::vector<uint8_t> clean = random_frame();
+            bool decoded = false;
+            bool other = false;
+            for (size_t b = 0; b < clean.size(); b++)
+            {
+                  parser.push(clean[b]);
+                  while (uint8_t len = parser.read_frame(out))
+                  {
+                        CHECK(well_formed(out, len));
+                        // Only on the last byte, and only the frame we sent
+                        if (b == clean.size() - 1 && len == clean.size() && !memcmp(out, clean.data(), len))
+                              decoded = true;
+                        else
+                              other = true;
+                  }
+            }
+            if (!decoded)
+            {
+                  // Lost without anything else to show for it would be a parser bug, not bad luck
+                  CHECK(other);
+                  swallowed++;
+            }
+      }
+      printf("  %u of %u clean frames swallowed by a frame that started in the noise\n", swallowed, iterations);
+      CHECK(swallowed * 1000 < iterations);
+}
+
+/*
+      Nothing but clean frames, back to back: every one comes out, in order, with nothing dropped. Commands are kept off
+            the address bytes; a frame like F2 F2 F2 ... could hold a shorter frame of its own one byte in, and the
+            controller never sends one
+*/
+static void test_clean_stream()
+{
+      FrameParser parser;
+      uint8_t out[JARVIS_PACKET_MAX_LEN];
+      uint32_t mismatches = 0;
+      for (uint32_t i = 0; i < iterations; i++)
+      {
+            std::vector<uint8_t> clean = random_frame();
+            if (clean[2] == JARVIS_ADDR_CONTROLLER || clean[2] == JARVIS_ADDR_HANDSET)
+                  continue;
+            uint8_t got = 0;
+            for (uint8_t b : clean)
+            {
+                  parser.push(b);
+                  while (uint8_t len = parser.read_frame(out))
+                        got = len;
+            }
+            if (got != clean.size() || memcmp(out, clean.data(), got))
+                  mismatches++;
+      }
+      CHECK_EQ(mismatches, 0);
+      CHECK_EQ(parser.dropped_bytes, 0);
+      CHECK_EQ(parser.checksum_failures, 0);
+}
+
+// Random streams, no clean frames. Whatever comes out has to be well formed
+static void test_random_streams()
+{
+      FrameParser parser;
+      uint8_t out[JARVIS_PACKET_MAX_LEN];
+      uint32_t frames = 0;
+      for (uint32_t i = 0; i < iterations * 8; i++)
+      {
+            parser.push(random_byte());
+            while (uint8_t len = parser.read_frame(out))
+            {
+                  CHECK(well_formed(out, len));
+                  frames++;
+            }
+      }
+      CHECK_EQ(frames, parser.frames);
+}
+
+// Every way a frame can be cut short, followed by a clean frame that has to come through
+static void test_truncated_frames()
+{
+      uint8_t out[JARVIS_PACKET_MAX_LEN];
+      for (uint32_t i = 0; i < 1000; i++)
+      {
+            std::vector<uint8_t> cut = random_frame();
+            std::vector<uint8_t> clean = random_frame();
+            for (size_t keep = 1; keep < cut.size(); keep++)
+            {
+                  FrameParser parser;
+                  for (size_t b = 0; b < keep; b++)
+                        parser.push(cut[b]);
+                  uint8_t last = 0;
+                  for (uint8_t b : clean)
+                  {
+                        parser.push(b);
+                        while (uint8_t len = parser.read_frame(out))
+                              last = len;
+                  }
+                  // Swallowing only happens when the two happen to checksum together; don't count those
+                  if (last != clean.size() || memcmp(out, clean.data(), last))
+                        CHECK(parser.frames != 0 && well_formed(out, last));
+            }
+      }
+}
+
+// Every param count byte, from every address, ahead of a clean frame
+static void test_bad_lengths()
+{
+      uint8_t out[JARVIS_PACKET_MAX_LEN];
+      for (uint8_t addr : {JARVIS_ADDR_CONTROLLER, JARVIS_ADDR_HANDSET})
+      {
+            for (uint16_t param_len = 0; param_len < 256; param_len++)
+            {
+                  FrameParser parser;
+                  const uint8_t head[] = {addr, addr, JARVIS_CMD_HEIGHT, (uint8_t)param_len};
+                  for (uint8_t b : head)
+                        parser.push(b);
+                  while (parser.read_frame(out))
+                        ;
+
+                  std::vector<uint8_t> clean = {JARVIS_ADDR_CONTROLLER, JARVIS_ADDR_CONTROLLER, 0x01, 0x03, 0x02, 0xD0, 0x00, 0xD6, 0x7E};
+                  bool decoded = false;
+                  for (uint8_t b : clean)
+                  {
+                        parser.push(b);
+                        while (uint8_t len = parser.read_frame(out))
+                              decoded = len == clean.size() && !memcmp(out, clean.data(), len);
+                  }
+                  CHECK(decoded);
+            }
+      }
+}
+
+// verify_checksum() against every length it could be handed, over a buffer exactly as big as a frame gets
+static void test_verify_checksum_bounds()
+{
+      uint8_t frame[JARVIS_PACKET_MAX_LEN];
+      for (uint16_t len = 0; len < 256; len++)
+      {
+            for (uint16_t param_len = 0; param_len < 256; param_len++)
+            {
+                  for (uint8_t i = 0; i < sizeof(frame); i++)
+                        frame[i] = rng();
+                  frame[3] = param_len;
+                  bool ok = verify_checksum(frame, len);
+                  if (ok)
+                        CHECK(param_len + JARVIS_FRAME_OVERHEAD == len);
+            }
+      }
+}
+
+/*
+      Corrupt height reports whose checksum still adds up. An 8 bit sum can't catch them, so it's down to the plausibility
+            checks: one that's further from the real height than the desk could have moved must never be published.
+*/
+static void test_checksum_collisions_dont_publish()
+{
+      host::HostDesk bench;
+      bench.setup();
+      bench.run_for(100);
+
+      const uint16_t real = 720;
+      uint8_t frame[JARVIS_PACKET_MAX_LEN];
+      bench.send(frame, host::make_controller_frame(frame, JARVIS_CMD_UNITS, &JARVIS_UNITS_CM, 1));
+      uint32_t collisions = 0;
+      for (uint32_t i = 0; i < iterations / 20; i++)
+      {
+            const uint8_t params[] = {real >> 8, real & 0xFF, 0x00};
+            bench.send(frame, host::make_controller_frame(frame, JARVIS_CMD_HEIGHT, params, sizeof(params)));
+            bench.run_for(25);
+
+            // Any height more than the desk can move in 50ms (plus slack) away, with the third param soaking up the
+            //    difference so the checksum still matches
+            uint16_t fake;
+            do
+                  fake = rng();
+            while (abs((int)fake - real) * 10 < 120);
+            uint8_t fix = (real >> 8) + (real & 0xFF) - (fake >> 8) - (fake & 0xFF);
+            const uint8_t forged[] = {(uint8_t)(fake >> 8), (uint8_t)fake, fix};
+            bench.send(frame, host::make_controller_frame(frame, JARVIS_CMD_HEIGHT, forged, sizeof(forged)));
+            CHECK_EQ(frame[7], (uint8_t)(JARVIS_CMD_HEIGHT + 3 + params[0] + params[1] + params[2]));
+            collisions++;
+            bench.run_for(25);
+
+            if (fabs(bench.height.state - real * .001f) > 0.00005f)
+            {
+                  printf("  published %.4f m after a forged report of %u\n", bench.height.state, fake);
+                  CHECK(false);
+                  break;
+            }
+      }
+      printf("  %u forged height reports held back\n", collisions);
+}
+
+int main(int argc, char **argv)
+{
+      if (argc > 1)
+            iterations = strtoul(argv[1], nullptr, 10);
+      if (argc > 2)
+            rng.seed(strtoul(argv[2], nullptr, 10));
+
+      RUN_TEST(test_resyncs_after_random_prefix);
+      RUN_TEST(test_clean_stream);
+      RUN_TEST(test_random_streams);
+      RUN_TEST(test_truncated_frames);
+      RUN_TEST(test_bad_lengths);
+      RUN_TEST(test_verify_checksum_bounds);
+      RUN_TEST(test_checksum_collisions_dont_publish);
+      return host::check_failures != 0;
+}